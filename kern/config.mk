@@ -190,6 +190,22 @@ ifneq "$(strip $(DEBUG_VPIC) $(DEBUG_VDEV) $(DEBUG_HVM_ALL) $(DEBUG_ALL))" ""
 KERN_DEBUG_FLAGS	+= -DDEBUG_VPIC -DDEBUG_HVM -DDEBUG_MSG
 endif
 
+#
+# Physical memory allocator switches.
+#
+
+# If set, keep all free normal pages on a doubly linked list, so that palloc
+# takes the most recently freed page in constant time
+ifdef ENABLE_PMM_FREELIST
+KERN_DEBUG_FLAGS	+= -DENABLE_PMM_FREELIST
+endif
+
+# If set, the allocation policy behind palloc/pfree (lifo, nextfit, bestfit or
+# buddy); pmm_policy=<name> on the kernel command line overrides it at boot
+ifdef PMM_POLICY
+KERN_DEBUG_FLAGS	+= -DPMM_POLICY=\"$(PMM_POLICY)\"
+endif
+
 #
 # Performace trace switches.
 #
@@ -243,3 +259,8 @@ endif
 ifneq "$(TEST)" ""
 KERN_DEBUG_FLAGS += -DTEST
 endif
+
+# If set, run the benchmarks of the physical memory allocator at boot.
+ifneq "$(BENCH)" ""
+KERN_DEBUG_FLAGS += -DBENCH
+endif
@@ -15,6 +15,8 @@ struct {
     uint32_t rpos, wpos;
 } cons;
 
+static void (*cons_idle)(void) = NULL;
+
 void cons_init()
 {
     memset(&cons, 0x0, sizeof(cons));
@@ -61,12 +63,22 @@ void cons_putc(char c)
     video_putc(c);
 }
 
+/*
+ * Sets the function getchar runs repeatedly while it waits for input.
+ */
+void cons_set_idle(void (*proc)(void))
+{
+    cons_idle = proc;
+}
+
 char getchar(void)
 {
     char c;
 
-    while ((c = cons_getc()) == 0)
-        /* do nothing */ ;
+    while ((c = cons_getc()) == 0) {
+        if (cons_idle != NULL)
+            (*cons_idle)();
+    }
     return c;
 }
 
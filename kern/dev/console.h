@@ -9,6 +9,7 @@ void cons_init(void);
 void cons_enable_kbd(void);
 void cons_putc(char c);
 void cons_intr(int (*proc)(void));
+void cons_set_idle(void (*proc)(void));
 char *readline(const char *prompt);
 
 #endif  /* _KERN_ */
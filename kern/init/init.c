@@ -1,15 +1,48 @@
 #include <lib/debug.h>
 #include <lib/types.h>
 #include <lib/monitor.h>
+#include <lib/string.h>
+#include <dev/console.h>
+#include <dev/mboot.h>
 #include <pmm/MATInit/export.h>
+#include <pmm/MATOp/export.h>
+#include <pmm/MATBuddy/export.h>
+#include <pmm/MATSlab/export.h>
+#include <pmm/MATDedup/export.h>
 
 #define NUM_CHAN     64
 #define TD_STATE_RUN 1
 
+// Number of free 4MB blocks kept whole for large pages.
+#define NUM_LARGE_RESERVE 4
+
+// Free page watermarks of the page allocator: 1MB, 4MB and 8MB.
+#define PMM_WMARK_MIN  256
+#define PMM_WMARK_LOW  1024
+#define PMM_WMARK_HIGH 2048
+
+// Number of registered pages visited by the same-page merging scanner
+// each time the console is idle.
+#define DEDUP_IDLE_SCAN 16
+
+// Longest value of an option on the kernel command line.
+#define OPTION_LEN 32
+
 #ifdef TEST
 extern bool test_MATIntro(void);
+extern bool test_MATExtent(void);
 extern bool test_MATInit(void);
 extern bool test_MATOp(void);
+extern bool test_MATBuddy(void);
+extern bool test_MATSlab(void);
+extern bool test_MATHeap(void);
+extern bool test_MATDedup(void);
+#endif
+
+#ifdef BENCH
+extern void bench_MATIntro(void);
+extern void bench_MATOp(void);
+extern void bench_MATHeap(void);
 #endif
 
 static void kern_main(void)
@@ -24,6 +57,13 @@ static void kern_main(void)
         dprintf("Test failed.\n");
     dprintf("\n");
 
+    dprintf("Testing the MATExtent layer...\n");
+    if (test_MATExtent() == 0)
+        dprintf("All tests passed.\n");
+    else
+        dprintf("Test failed.\n");
+    dprintf("\n");
+
     dprintf("Testing the MATInit layer...\n");
     if (test_MATInit() == 0)
         dprintf("All tests passed.\n");
@@ -37,14 +77,114 @@ static void kern_main(void)
     else
         dprintf("Test failed.\n");
     dprintf("\n");
+
+    dprintf("Testing the MATBuddy layer...\n");
+    if (test_MATBuddy() == 0)
+        dprintf("All tests passed.\n");
+    else
+        dprintf("Test failed.\n");
+    dprintf("\n");
+
+    dprintf("Testing the MATSlab layer...\n");
+    if (test_MATSlab() == 0)
+        dprintf("All tests passed.\n");
+    else
+        dprintf("Test failed.\n");
+    dprintf("\n");
+
+    dprintf("Testing the MATHeap layer...\n");
+    if (test_MATHeap() == 0)
+        dprintf("All tests passed.\n");
+    else
+        dprintf("Test failed.\n");
+    dprintf("\n");
+
+    dprintf("Testing the MATDedup layer...\n");
+    if (test_MATDedup() == 0)
+        dprintf("All tests passed.\n");
+    else
+        dprintf("Test failed.\n");
+    dprintf("\n");
+#endif
+
+#ifdef BENCH
+    dprintf("Benchmarking the MATIntro layer...\n");
+    bench_MATIntro();
+    dprintf("\n");
+
+    dprintf("Benchmarking the MATOp layer...\n");
+    bench_MATOp();
+    dprintf("\n");
+
+    dprintf("Benchmarking the MATHeap layer...\n");
+    bench_MATHeap();
+    dprintf("\n");
 #endif
 
     monitor(NULL);
 }
 
+/**
+ * Copies the value of the option name=value from the kernel command line
+ * passed by the boot loader into buf, and returns buf.
+ * Returns the given default if the option is not there.
+ */
+static const char *boot_option(uintptr_t mbi_addr, const char *name,
+                               char *buf, const char *def)
+{
+    mboot_info_t *mbi = (mboot_info_t *) mbi_addr;
+    const char *p;
+    unsigned int len = strnlen(name, OPTION_LEN);
+    unsigned int i;
+
+    if ((mbi->flags & (1 << 2)) == 0 || mbi->cmdline == 0)
+    {
+        return def;
+    }
+    for (p = (const char *) mbi->cmdline; *p != '\0'; p++)
+    {
+        if ((p == (const char *) mbi->cmdline || p[-1] == ' ')
+            && strncmp(p, name, len) == 0 && p[len] == '=')
+        {
+            p += len + 1;
+            for (i = 0; i < OPTION_LEN - 1 && p[i] != '\0' && p[i] != ' '; i++)
+            {
+                buf[i] = p[i];
+            }
+            buf[i] = '\0';
+            return buf;
+        }
+    }
+    return def;
+}
+
+/**
+ * Run while the console waits for input: the page allocator zeroes pages
+ * and reclaims memory, then the same-page merging scanner hashes a few pages.
+ */
+static void kern_idle(void)
+{
+    palloc_idle();
+    dedup_scan(DEDUP_IDLE_SCAN);
+}
+
 void kern_init(uintptr_t mbi_addr)
 {
+    char buf[OPTION_LEN];
+    const char *policy;
+
     pmem_init(mbi_addr);
+    palloc_policy_register(&buddy_palloc_ops);
+    policy = boot_option(mbi_addr, "pmm_policy", buf, PMM_POLICY);
+    if (palloc_policy_select(policy) == 0)
+    {
+        KERN_WARN("Unknown allocation policy %s.\n", policy);
+    }
+    KERN_DEBUG("Allocation policy: %s.\n", palloc_policy_name());
+    palloc_large_reserve(NUM_LARGE_RESERVE);
+    palloc_set_watermarks(PMM_WMARK_MIN, PMM_WMARK_LOW, PMM_WMARK_HIGH);
+    palloc_shrinker_register(kmem_reap);
+    cons_set_idle(kern_idle);
 
     KERN_DEBUG("Kernel initialized.\n");
 
@@ -7,6 +7,7 @@
 #include <lib/x86.h>
 #include <lib/monitor.h>
 #include <dev/console.h>
+#include <pmm/MATDedup/export.h>
 
 #define CMDBUF_SIZE 80  // enough for one VGA text line
 
@@ -20,6 +21,7 @@ struct Command {
 static struct Command commands[] = {
     {"help", "Display this list of commands", mon_help},
     {"kerninfo", "Display information about the kernel", mon_kerninfo},
+    {"dedup", "Display the pages saved by same-page merging and its cost", mon_dedup},
 };
 
 #define NCOMMANDS (sizeof(commands) / sizeof(commands[0]))
@@ -48,6 +50,23 @@ int mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
     return 0;
 }
 
+int mon_dedup(int argc, char **argv, struct Trapframe *tf)
+{
+    struct dedup_stats stats;
+
+    dedup_stats(&stats);
+    dprintf("Registered pages: %u\n", stats.nrefs);
+    dprintf("Pages saved:      %u (%uKB)\n", stats.nsaved, stats.nsaved * 4);
+    dprintf("Pages hashed:     %u\n", stats.nscanned);
+    dprintf("Scanner cycles:   %llu", stats.cycles);
+    if (stats.nscanned != 0)
+    {
+        dprintf(" (%llu per page)", stats.cycles / stats.nscanned);
+    }
+    dprintf("\n");
+    return 0;
+}
+
 int mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 {
     // TODO
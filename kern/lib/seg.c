@@ -7,12 +7,26 @@
 
 static tss_t tss0;
 uint8_t bsp_kstack[4096] gcc_aligned(4096);
-char STACK_LOC[64][4096] gcc_aligned(4096);
+char STACK_LOC[NUM_CPUS][4096] gcc_aligned(4096);
 
 #define offsetof(type, member) __builtin_offsetof(type, member)
 
 segdesc_t gdt_LOC[CPU_GDT_NDESC];
-tss_t tss_LOC[64];
+tss_t tss_LOC[NUM_CPUS];
+
+/*
+ * Returns the index of the current CPU, found from the kernel stack it runs on:
+ * CPU i runs on STACK_LOC[i]. The bootstrap processor starts on bsp_kstack,
+ * which counts as CPU 0.
+ */
+unsigned int get_pcpu_idx(void)
+{
+    uint32_t esp = read_esp();
+
+    if (esp >= (uint32_t) STACK_LOC && esp < (uint32_t) STACK_LOC + sizeof(STACK_LOC))
+        return (esp - (uint32_t) STACK_LOC) / 4096;
+    return 0;
+}
 
 void seg_init(void)
 {
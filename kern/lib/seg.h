@@ -83,6 +83,8 @@ typedef struct pseudodesc {
 #define CPU_GDT_TSS   0x28  /* task state segment */
 #define CPU_GDT_NDESC 6     /* number of GDT entries used */
 
+#define NUM_CPUS 64         /* max number of CPUs */
+
 #ifndef __ASSEMBLER__
 
 #include <lib/types.h>
@@ -177,6 +179,7 @@ typedef struct gatedesc {
 }
 
 void seg_init(void);
+unsigned int get_pcpu_idx(void);
 
 #endif  /* !__ASSEMBLER__ */
 
@@ -36,6 +36,13 @@ static inline uint32_t __attribute__ ((always_inline)) read_ebp(void)
     return ebp;
 }
 
+static inline uint32_t __attribute__ ((always_inline)) read_esp(void)
+{
+    uint32_t esp;
+    __asm __volatile ("movl %%esp,%0" : "=rm" (esp));
+    return esp;
+}
+
 void lldt(uint16_t sel);
 void cli(void);
 void sti(void);
@@ -0,0 +1,344 @@
+#include <lib/debug.h>
+#include <pmm/MATOp/policy.h>
+#include "import.h"
+
+#define PAGESIZE 4096
+#define VM_USERLO 0x40000000
+#define VM_USERHI 0xF0000000
+#define VM_USERLO_PI (VM_USERLO / PAGESIZE)
+#define VM_USERHI_PI (VM_USERHI / PAGESIZE)
+
+/**
+ * The buddy allocator hands out naturally aligned blocks of 2^order pages,
+ * for order 0 to BUDDY_MAX_ORDER.
+ *
+ * It takes memory from the AT one block of the maximal order (4MB) at a time.
+ * The free pages of those blocks are marked as cached in the AT, as the pages
+ * in the magazines of MATOp are, so they are never handed out by palloc but
+ * still count as free. The pages of a block handed out are marked as allocated
+ * instead, and a block of the maximal order is given back to the AT once all
+ * of its sub-blocks are freed and coalesced again.
+ * When no block of the maximal order is free in the AT, a block of the
+ * requested order is taken on its own instead, and given back to the AT
+ * as soon as it is freed.
+ */
+#define BUDDY_MAX_ORDER 10
+#define BUDDY_NORDERS   (BUDDY_MAX_ORDER + 1)
+
+// Number of pages covered by one word of the free bitmap in the AT.
+#define AT_WORD_BITS 32
+
+/**
+ * The free blocks of each order are kept in a doubly linked list.
+ * The links are stored at the beginning of the free block itself,
+ * and a link value of 0 means the end of the list.
+ */
+struct buddy_link
+{
+    unsigned int prev;
+    unsigned int next;
+};
+
+#define BUDDY_LINK(page_index) ((struct buddy_link *) ((page_index) * PAGESIZE))
+
+static unsigned int buddy_head[BUDDY_NORDERS];
+
+// Number of pages in all the free blocks.
+static unsigned int buddy_nfree = 0;
+
+/**
+ * The free blocks of each order are also recorded in a bitmap with one bit
+ * per aligned block in [VM_USERLO, VM_USERHI), so that whether the buddy of
+ * a block is free can be checked without touching the buddy itself.
+ * The bitmaps of all orders are stored one after another in buddy_map.
+ */
+#define BUDDY_NPAGES (VM_USERHI_PI - VM_USERLO_PI)
+#define BUDDY_MAP_BASE(order) \
+    ((2 * BUDDY_NPAGES - ((2 * BUDDY_NPAGES) >> (order))) / 32)
+
+static unsigned int buddy_map[BUDDY_MAP_BASE(BUDDY_NORDERS)];
+
+#define BUDDY_MAP_BIT(page_index, order) \
+    (((page_index) - VM_USERLO_PI) >> (order))
+
+/**
+ * One bit per block of the maximal order, set while the block is taken whole
+ * from the AT, so that its sub-blocks are kept in the lists when freed.
+ */
+static unsigned int buddy_whole[(BUDDY_NPAGES >> BUDDY_MAX_ORDER) / 32 + 1];
+
+#define BUDDY_WHOLE_BIT(page_index) BUDDY_MAP_BIT(page_index, BUDDY_MAX_ORDER)
+
+static unsigned int buddy_is_whole(unsigned int page_index)
+{
+    unsigned int bit = BUDDY_WHOLE_BIT(page_index);
+
+    return (buddy_whole[bit / 32] >> (bit % 32)) & 0x1;
+}
+
+static void buddy_set_whole(unsigned int page_index, unsigned int whole)
+{
+    unsigned int bit = BUDDY_WHOLE_BIT(page_index);
+
+    if (whole)
+    {
+        buddy_whole[bit / 32] |= 1u << (bit % 32);
+    }
+    else
+    {
+        buddy_whole[bit / 32] &= ~(1u << (bit % 32));
+    }
+}
+
+static unsigned int buddy_is_free(unsigned int page_index, unsigned int order)
+{
+    unsigned int bit = BUDDY_MAP_BIT(page_index, order);
+
+    return (buddy_map[BUDDY_MAP_BASE(order) + bit / 32] >> (bit % 32)) & 0x1;
+}
+
+static void buddy_push(unsigned int page_index, unsigned int order)
+{
+    unsigned int bit = BUDDY_MAP_BIT(page_index, order);
+    struct buddy_link *link = BUDDY_LINK(page_index);
+
+    link->prev = 0;
+    link->next = buddy_head[order];
+    if (buddy_head[order] != 0)
+    {
+        BUDDY_LINK(buddy_head[order])->prev = page_index;
+    }
+    buddy_head[order] = page_index;
+    buddy_nfree += 1u << order;
+
+    buddy_map[BUDDY_MAP_BASE(order) + bit / 32] |= 1u << (bit % 32);
+}
+
+static void buddy_remove(unsigned int page_index, unsigned int order)
+{
+    unsigned int bit = BUDDY_MAP_BIT(page_index, order);
+    struct buddy_link *link = BUDDY_LINK(page_index);
+
+    if (link->prev != 0)
+    {
+        BUDDY_LINK(link->prev)->next = link->next;
+    }
+    else
+    {
+        buddy_head[order] = link->next;
+    }
+    if (link->next != 0)
+    {
+        BUDDY_LINK(link->next)->prev = link->prev;
+    }
+    buddy_nfree -= 1u << order;
+
+    buddy_map[BUDDY_MAP_BASE(order) + bit / 32] &= ~(1u << (bit % 32));
+}
+
+/**
+ * Returns 1 if the naturally aligned block of npages pages starting from
+ * the given page is all normal and unallocated in the AT.
+ */
+static unsigned int buddy_block_free(unsigned int block, unsigned int npages)
+{
+    unsigned int mask;
+    unsigned int word_index;
+
+    if (npages < AT_WORD_BITS)
+    {
+        mask = ((1u << npages) - 1) << (block % AT_WORD_BITS);
+        return (at_free_word(block / AT_WORD_BITS) & mask) == mask;
+    }
+
+    for (word_index = block / AT_WORD_BITS;
+         word_index < (block + npages) / AT_WORD_BITS; word_index++)
+    {
+        if (at_free_word(word_index) != ~0u)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Takes a naturally aligned block of the given order whose pages are all
+ * normal and unallocated from the AT, and marks its pages as cached.
+ * Returns the index of the first page of the block, or 0 if there is none.
+ */
+static unsigned int buddy_grow(unsigned int order)
+{
+    unsigned int page_index;
+    unsigned int block;
+
+    page_index = at_next_free(VM_USERLO_PI);
+    while (page_index < VM_USERHI_PI)
+    {
+        block = page_index & ~((1u << order) - 1);
+        if (buddy_block_free(block, 1u << order))
+        {
+            at_set_cached_range(block, block + (1u << order), 1);
+            return block;
+        }
+        page_index = at_next_free(block + (1u << order));
+    }
+
+    return 0;
+}
+
+/**
+ * Allocates a naturally aligned block of 2^order physical pages.
+ *
+ * It takes the first block of the smallest order not less than the requested one,
+ * and splits it, putting the unused halves back to the lists of the lower orders.
+ * Returns the index of the first page of the block, or 0 if there is no
+ * block large enough.
+ */
+unsigned int palloc_order(unsigned int order)
+{
+    unsigned int cur_order;
+    unsigned int block;
+
+    if (order > BUDDY_MAX_ORDER)
+    {
+        return 0;
+    }
+
+    for (cur_order = order; cur_order <= BUDDY_MAX_ORDER; cur_order++)
+    {
+        if (buddy_head[cur_order] != 0)
+        {
+            break;
+        }
+    }
+
+    if (cur_order > BUDDY_MAX_ORDER)
+    {
+        cur_order = BUDDY_MAX_ORDER;
+        block = buddy_grow(cur_order);
+        if (block != 0)
+        {
+            buddy_set_whole(block, 1);
+        }
+        else if (order < BUDDY_MAX_ORDER)
+        {
+            cur_order = order;
+            block = buddy_grow(cur_order);
+        }
+        if (block == 0)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        block = buddy_head[cur_order];
+        buddy_remove(block, cur_order);
+    }
+
+    while (cur_order > order)
+    {
+        cur_order--;
+        buddy_push(block + (1u << cur_order), cur_order);
+    }
+
+    at_set_allocated_range(block, block + (1u << order), 1);
+    at_set_cached_range(block, block + (1u << order), 0);
+    return block;
+}
+
+/**
+ * Frees a block of 2^order physical pages allocated by palloc_order.
+ *
+ * As long as the buddy of the block is also free, the two are merged into
+ * a block of the next order. A block of the maximal order is given back to the AT.
+ * Blocks of a bad order, outside the user range, not aligned to their
+ * order or not allocated are ignored.
+ */
+void pfree_order(unsigned int pfree_index, unsigned int order)
+{
+    unsigned int buddy;
+
+    if (order > BUDDY_MAX_ORDER || pfree_index < VM_USERLO_PI
+        || pfree_index >= VM_USERHI_PI || (pfree_index & ((1u << order) - 1)) != 0
+        || at_is_allocated(pfree_index) == 0)
+    {
+        return;
+    }
+
+    if (buddy_is_whole(pfree_index) == 0)
+    {
+        at_set_allocated_range(pfree_index, pfree_index + (1u << order), 0);
+        return;
+    }
+
+    at_set_cached_range(pfree_index, pfree_index + (1u << order), 1);
+    at_set_allocated_range(pfree_index, pfree_index + (1u << order), 0);
+
+    while (order < BUDDY_MAX_ORDER)
+    {
+        buddy = pfree_index ^ (1u << order);
+        if (buddy_is_free(buddy, order) == 0)
+        {
+            break;
+        }
+        buddy_remove(buddy, order);
+        pfree_index &= ~(1u << order);
+        order++;
+    }
+
+    if (order < BUDDY_MAX_ORDER)
+    {
+        buddy_push(pfree_index, order);
+        return;
+    }
+
+    buddy_set_whole(pfree_index, 0);
+    at_set_cached_range(pfree_index, pfree_index + (1u << BUDDY_MAX_ORDER), 0);
+}
+
+/**
+ * The buddy allocator as an allocation policy of MATOp: single pages are
+ * blocks of order 0, and n contiguous pages are a block of the smallest order
+ * that holds them, up to 4MB.
+ */
+static unsigned int buddy_order_of(unsigned int n)
+{
+    unsigned int order = 0;
+
+    while (order <= BUDDY_MAX_ORDER && (1u << order) < n)
+    {
+        order++;
+    }
+    return order;
+}
+
+static unsigned int buddy_alloc(void)
+{
+    return palloc_order(0);
+}
+
+static void buddy_free(unsigned int page_index)
+{
+    pfree_order(page_index, 0);
+}
+
+static unsigned int buddy_alloc_n(unsigned int n)
+{
+    return palloc_order(buddy_order_of(n));
+}
+
+static void buddy_free_n(unsigned int page_index, unsigned int n)
+{
+    pfree_order(page_index, buddy_order_of(n));
+}
+
+static void buddy_stats(struct palloc_stats *stats)
+{
+    stats->cached = buddy_nfree;
+}
+
+const struct palloc_ops buddy_palloc_ops = {
+    "buddy", buddy_alloc, buddy_free, buddy_alloc_n, buddy_free_n, buddy_stats
+};
@@ -0,0 +1,15 @@
+#ifndef _KERN_PMM_MATBUDDY_H_
+#define _KERN_PMM_MATBUDDY_H_
+
+#ifdef _KERN_
+
+unsigned int palloc_order(unsigned int order);
+void pfree_order(unsigned int pfree_index, unsigned int order);
+
+// The buddy allocator as an allocation policy, see palloc_policy_register.
+struct palloc_ops;
+extern const struct palloc_ops buddy_palloc_ops;
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATBUDDY_H_ */
@@ -0,0 +1,29 @@
+#ifndef _KERN_PMM_MATBUDDY_H_
+#define _KERN_PMM_MATBUDDY_H_
+
+#ifdef _KERN_
+
+/**
+ * The getter and setter functions implemented in the MATIntro layer.
+ */
+
+// One word of the free bitmap: bit i is set iff the page with index
+// (word_index * 32 + i) is normal and unallocated.
+unsigned int at_free_word(unsigned int word_index);
+
+// The index of the first normal and unallocated page not below the given index,
+// or 2^20 if there is none.
+unsigned int at_next_free(unsigned int page_index);
+
+// Whether the page with the given index is already allocated.
+unsigned int at_is_allocated(unsigned int page_index);
+
+// Mark the allocation flags of the pages [lo, hi) using the given value.
+void at_set_allocated_range(unsigned int lo, unsigned int hi, unsigned int allocated);
+
+// Mark the pages [lo, hi) as held in a page cache, or not.
+void at_set_cached_range(unsigned int lo, unsigned int hi, unsigned int cached);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATBUDDY_H_ */
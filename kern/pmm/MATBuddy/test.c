@@ -0,0 +1,181 @@
+#include <lib/debug.h>
+#include <lib/string.h>
+#include <pmm/MATIntro/export.h>
+#include <pmm/MATOp/export.h>
+#include "export.h"
+
+#define PAGESIZE 4096
+#define VM_USERLO 0x40000000
+#define VM_USERHI 0xF0000000
+#define VM_USERLO_PI (VM_USERLO / PAGESIZE)
+#define VM_USERHI_PI (VM_USERHI / PAGESIZE)
+
+// More order 3 blocks than the tests expect to find free before one is split.
+#define TEST_NBLOCKS 256
+
+int MATBuddy_test1()
+{
+    unsigned int page_index = palloc_order(0);
+    if (page_index < VM_USERLO_PI || VM_USERHI_PI <= page_index)
+    {
+        dprintf("test 1.1 failed: (%d < VM_USERLO_PI || VM_USERHI_PI <= %d)\n", page_index, page_index);
+        return 1;
+    }
+    if (at_is_allocated(page_index) != 1)
+    {
+        dprintf("test 1.2 failed: (%d != 1)\n", at_is_allocated(page_index));
+        pfree_order(page_index, 0);
+        return 1;
+    }
+    pfree_order(page_index, 0);
+    if (at_is_allocated(page_index) != 0)
+    {
+        dprintf("test 1.3 failed: (%d != 0)\n", at_is_allocated(page_index));
+        return 1;
+    }
+    dprintf("test 1 passed.\n");
+    return 0;
+}
+
+int MATBuddy_test2()
+{
+    unsigned int block1 = palloc_order(3);
+    unsigned int block2 = palloc_order(3);
+    if (block1 == 0 || block2 == 0 || block1 == block2)
+    {
+        dprintf("test 2.1 failed: (%d == 0 || %d == 0 || %d == %d)\n", block1, block2, block1, block2);
+        if (block1 != 0)
+        {
+            pfree_order(block1, 3);
+        }
+        if (block2 != 0 && block2 != block1)
+        {
+            pfree_order(block2, 3);
+        }
+        return 1;
+    }
+    if (block1 % 8 != 0 || block2 % 8 != 0)
+    {
+        dprintf("test 2.2 failed: (%d %% 8 != 0 || %d %% 8 != 0)\n", block1, block2);
+        pfree_order(block1, 3);
+        pfree_order(block2, 3);
+        return 1;
+    }
+    pfree_order(block1, 3);
+    pfree_order(block2, 3);
+    if (at_is_allocated(block1) != 0 || at_is_allocated(block2 + 7) != 0)
+    {
+        dprintf("test 2.3 failed: (%d != 0 || %d != 0)\n", at_is_allocated(block1), at_is_allocated(block2 + 7));
+        return 1;
+    }
+    if (palloc_order(11) != 0)
+    {
+        dprintf("test 2.4 failed: (palloc_order(11) != 0)\n");
+        return 1;
+    }
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+int MATBuddy_test3()
+{
+    static unsigned int blocks[TEST_NBLOCKS];
+    unsigned int n = 0;
+    unsigned int merged;
+    // once no block of order 3 is free, the next one is split from a larger
+    // block, whose upper half is handed out right after the lower one
+    do
+    {
+        blocks[n] = palloc_order(3);
+        n++;
+    } while (blocks[n - 1] != 0 && (n < 2 || blocks[n - 1] != blocks[n - 2] + 8) && n < TEST_NBLOCKS);
+    if (n < 2 || blocks[n - 1] != blocks[n - 2] + 8)
+    {
+        dprintf("test 3.1 failed: no two buddies in %d blocks of order 3\n", n);
+        while (n > 0)
+        {
+            n--;
+            pfree_order(blocks[n], 3);
+        }
+        return 1;
+    }
+    // freeing both buddies merges them back into the block of order 4
+    pfree_order(blocks[n - 1], 3);
+    pfree_order(blocks[n - 2], 3);
+    merged = palloc_order(4);
+    if (merged != blocks[n - 2])
+    {
+        dprintf("test 3.2 failed: (%d != %d)\n", merged, blocks[n - 2]);
+        if (merged != 0)
+        {
+            pfree_order(merged, 4);
+        }
+        n -= 2;
+        while (n > 0)
+        {
+            n--;
+            pfree_order(blocks[n], 3);
+        }
+        return 1;
+    }
+    pfree_order(merged, 4);
+    n -= 2;
+    while (n > 0)
+    {
+        n--;
+        pfree_order(blocks[n], 3);
+    }
+    dprintf("test 3 passed.\n");
+    return 0;
+}
+
+/**
+ * Write Your Own Test Script (optional)
+ *
+ * Come up with your own interesting test cases to challenge your classmates!
+ * In addition to the provided simple tests, selected (correct and interesting) test functions
+ * will be used in the actual grading of the lab!
+ * Your test function itself will not be graded. So don't be afraid of submitting a wrong script.
+ *
+ * The test function should return 0 for passing the test and a non-zero code for failing the test.
+ * Be extra careful to make sure that if you overwrite some of the kernel data, they are set back to
+ * the original value. O.w., it may make the future test scripts to fail even if you implement all
+ * the functions correctly.
+ */
+int MATBuddy_test_own()
+{
+    unsigned int page_index;
+    unsigned int block;
+    // under the buddy policy, other pages in use may still hold blocks of 4MB
+    if (strcmp(palloc_policy_name(), "buddy") == 0)
+    {
+        dprintf("own test passed.\n");
+        return 0;
+    }
+    // all the blocks freed by the tests above are merged back into the AT,
+    // so a single page is split from a 4MB block taken from the AT
+    page_index = palloc_order(0);
+    block = page_index & ~1023u;
+    if (page_index != block || at_is_cached(block + 1) != 1 || at_is_cached(block + 1023) != 1
+        || at_next_free(block) < block + 1024)
+    {
+        dprintf("own test 1 failed: page %d not split from a 4MB block\n", page_index);
+        pfree_order(page_index, 0);
+        return 1;
+    }
+    // freeing it merges the 4MB block back, which goes back to the AT
+    pfree_order(page_index, 0);
+    if (at_is_cached(block) != 0 || at_is_cached(block + 1023) != 0 || at_next_free(block) != block
+        || at_next_free(block + 1023) != block + 1023)
+    {
+        dprintf("own test 2 failed: the 4MB block %d was not given back to the AT\n", block);
+        return 1;
+    }
+    dprintf("own test passed.\n");
+    return 0;
+}
+
+int test_MATBuddy()
+{
+    return MATBuddy_test1() + MATBuddy_test2() + MATBuddy_test3() + MATBuddy_test_own();
+}
@@ -0,0 +1,337 @@
+#include <lib/debug.h>
+#include <lib/string.h>
+#include <lib/types.h>
+#include <lib/x86.h>
+#include "import.h"
+#include "stats.h"
+
+#define PAGESIZE 4096
+
+/**
+ * Same-page merging: allocated pages with identical contents are merged into
+ * a single frame, shared read-only, whose users are counted by its reference
+ * count in the AT. The frame is marked as merged in the AT.
+ *
+ * There are no page tables above this layer, so the scanner cannot find the
+ * users of a page by itself. Instead, the user of a page registers the word
+ * that holds its page index, its reference, with dedup_register. When the page
+ * is merged, the scanner points the reference to the shared frame, takes a
+ * reference to the frame for it, and drops the one to the old page.
+ * A registered page must only be written through dedup_write, which first
+ * gives the user a private copy if the frame is shared.
+ *
+ * Each registered reference is in one of the states:
+ *   DEDUP_NEW: not hashed since it was registered or written.
+ *   DEDUP_STABLE: hashed, and the first reference to its frame. It is in the
+ *     hash table, where the scanner looks up the pages with the same hash.
+ *   DEDUP_MERGED: hashed, and its frame is the frame of a stable reference.
+ * So the number of pages saved is the number of merged references.
+ */
+#define DEDUP_MAX_REFS 4096
+#define DEDUP_NBUCKETS 1024
+
+#define DEDUP_FREE   0
+#define DEDUP_NEW    1
+#define DEDUP_STABLE 2
+#define DEDUP_MERGED 3
+
+/**
+ * The entries are named by their handle, their index plus one, so that
+ * the handle 0 means "no entry", at the end of a bucket or of the free list.
+ */
+struct dedup_ref
+{
+    unsigned int *ref;
+    unsigned int hash;
+    unsigned int state;
+    unsigned int next;
+};
+
+#define DEDUP_REF(handle) (&dedup_refs[(handle) - 1])
+
+static struct dedup_ref dedup_refs[DEDUP_MAX_REFS];
+static unsigned int dedup_nused = 0;
+static unsigned int dedup_free_head = 0;
+static unsigned int dedup_buckets[DEDUP_NBUCKETS];
+
+// The handle of the next entry visited by the scanner.
+static unsigned int dedup_cursor = 1;
+
+static unsigned int dedup_nrefs = 0;
+static unsigned int dedup_nsaved = 0;
+static unsigned int dedup_nscanned = 0;
+static uint64_t dedup_cycles = 0;
+
+#define DEDUP_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+ * Hashes the contents of the page a word at a time, in four independent
+ * lanes, so that the multiplications for consecutive words overlap.
+ */
+static unsigned int dedup_hash(unsigned int page_index)
+{
+    const unsigned int *words = (const unsigned int *) (page_index * PAGESIZE);
+    unsigned int h0 = 0x811c9dc5;
+    unsigned int h1 = 0x9e3779b9;
+    unsigned int h2 = 0x85ebca6b;
+    unsigned int h3 = 0xc2b2ae35;
+    unsigned int i;
+
+    for (i = 0; i < PAGESIZE / sizeof(unsigned int); i += 4)
+    {
+        h0 = (h0 ^ words[i]) * 0x01000193;
+        h1 = (h1 ^ words[i + 1]) * 0x01000193;
+        h2 = (h2 ^ words[i + 2]) * 0x01000193;
+        h3 = (h3 ^ words[i + 3]) * 0x01000193;
+    }
+    return h0 ^ DEDUP_ROTL(h1, 8) ^ DEDUP_ROTL(h2, 16) ^ DEDUP_ROTL(h3, 24);
+}
+
+/**
+ * Returns 1 if the two pages have the same contents.
+ */
+static unsigned int dedup_same(unsigned int a, unsigned int b)
+{
+    const unsigned int *wa = (const unsigned int *) (a * PAGESIZE);
+    const unsigned int *wb = (const unsigned int *) (b * PAGESIZE);
+    unsigned int i;
+
+    for (i = 0; i < PAGESIZE / sizeof(unsigned int); i++)
+    {
+        if (wa[i] != wb[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void dedup_link(unsigned int handle)
+{
+    struct dedup_ref *entry = DEDUP_REF(handle);
+    unsigned int bucket = entry->hash % DEDUP_NBUCKETS;
+
+    entry->state = DEDUP_STABLE;
+    entry->next = dedup_buckets[bucket];
+    dedup_buckets[bucket] = handle;
+}
+
+static void dedup_unlink(unsigned int handle)
+{
+    unsigned int *link = &dedup_buckets[DEDUP_REF(handle)->hash % DEDUP_NBUCKETS];
+
+    while (*link != handle)
+    {
+        link = &DEDUP_REF(*link)->next;
+    }
+    *link = DEDUP_REF(handle)->next;
+}
+
+/**
+ * Returns the handle of a stable entry whose page has the same contents as
+ * the page of the given entry, but another frame, or 0 if there is none.
+ */
+static unsigned int dedup_find(unsigned int handle)
+{
+    struct dedup_ref *entry = DEDUP_REF(handle);
+    struct dedup_ref *other;
+    unsigned int cur = dedup_buckets[entry->hash % DEDUP_NBUCKETS];
+
+    while (cur != 0)
+    {
+        other = DEDUP_REF(cur);
+        if (other->hash == entry->hash && *other->ref != *entry->ref
+            && dedup_same(*other->ref, *entry->ref))
+        {
+            return cur;
+        }
+        cur = other->next;
+    }
+    return 0;
+}
+
+/**
+ * Takes the entry out of the hash table or out of the merged entries,
+ * and makes it new again. If it was the stable entry of a frame that other
+ * entries are merged into, one of them becomes the stable entry instead.
+ */
+static void dedup_leave(unsigned int handle)
+{
+    struct dedup_ref *entry = DEDUP_REF(handle);
+    struct dedup_ref *other;
+    unsigned int i;
+
+    if (entry->state == DEDUP_MERGED)
+    {
+        dedup_nsaved--;
+    }
+    else if (entry->state == DEDUP_STABLE)
+    {
+        dedup_unlink(handle);
+        for (i = 1; i <= dedup_nused; i++)
+        {
+            other = DEDUP_REF(i);
+            if (other->state == DEDUP_MERGED && *other->ref == *entry->ref)
+            {
+                other->hash = entry->hash;
+                dedup_link(i);
+                dedup_nsaved--;
+                break;
+            }
+        }
+    }
+    entry->state = DEDUP_NEW;
+}
+
+/**
+ * Registers the reference to an allocated page, which is not shared yet.
+ * From now on, its contents may be merged with identical pages: the scanner
+ * may then set the reference to another page index, whose frame is read-only.
+ * The page must be given back with page_put, once unregistered.
+ * Returns the handle of the reference, or 0 if the table is full.
+ */
+unsigned int dedup_register(unsigned int *ref)
+{
+    unsigned int handle;
+
+    if (dedup_free_head != 0)
+    {
+        handle = dedup_free_head;
+        dedup_free_head = DEDUP_REF(handle)->next;
+    }
+    else if (dedup_nused < DEDUP_MAX_REFS)
+    {
+        handle = ++dedup_nused;
+    }
+    else
+    {
+        return 0;
+    }
+
+    DEDUP_REF(handle)->ref = ref;
+    DEDUP_REF(handle)->state = DEDUP_NEW;
+    dedup_nrefs++;
+    return handle;
+}
+
+/**
+ * Unregisters the reference, whose page is then no longer merged, nor
+ * merged into. The page it holds stays shared if it was merged, so it must
+ * still be written through a private copy, or dropped with page_put.
+ */
+void dedup_unregister(unsigned int handle)
+{
+    struct dedup_ref *entry = DEDUP_REF(handle);
+
+    dedup_leave(handle);
+    entry->state = DEDUP_FREE;
+    entry->next = dedup_free_head;
+    dedup_free_head = handle;
+    dedup_nrefs--;
+}
+
+/**
+ * Makes the page of the reference writable: if its frame is shared, the
+ * reference is set to a private copy of it. The page will be hashed again.
+ * Returns the index of the page to write, or 0 if the frame is shared and
+ * there is no free page for the copy.
+ */
+unsigned int dedup_write(unsigned int handle)
+{
+    struct dedup_ref *entry = DEDUP_REF(handle);
+    unsigned int frame = *entry->ref;
+    unsigned int copy = 0;
+
+    if (at_get_ref(frame) > 1)
+    {
+        copy = palloc();
+        if (copy == 0)
+        {
+            return 0;
+        }
+    }
+
+    dedup_leave(handle);
+    if (copy == 0)
+    {
+        at_set_merged(frame, 0);
+        return frame;
+    }
+
+    memcpy((void *) (copy * PAGESIZE), (void *) (frame * PAGESIZE), PAGESIZE);
+    *entry->ref = copy;
+    page_put(frame);
+    if (at_get_ref(frame) == 1)
+    {
+        at_set_merged(frame, 0);
+    }
+    return copy;
+}
+
+/**
+ * Visits the next nrefs entries, hashing the new ones. A new page with the
+ * same contents as the page of a stable entry is merged into its frame;
+ * otherwise it becomes stable itself. It is meant to be called while the CPU
+ * has nothing else to do. Returns the number of pages merged.
+ */
+unsigned int dedup_scan(unsigned int nrefs)
+{
+    struct dedup_ref *entry;
+    unsigned int handle;
+    unsigned int other;
+    unsigned int frame;
+    unsigned int nmerged = 0;
+    uint64_t start;
+
+    if (dedup_nrefs == 0)
+    {
+        return 0;
+    }
+
+    start = rdtsc();
+    while (nrefs-- > 0)
+    {
+        if (dedup_cursor > dedup_nused)
+        {
+            dedup_cursor = 1;
+        }
+        handle = dedup_cursor++;
+        entry = DEDUP_REF(handle);
+        if (entry->state != DEDUP_NEW)
+        {
+            continue;
+        }
+
+        entry->hash = dedup_hash(*entry->ref);
+        dedup_nscanned++;
+        other = dedup_find(handle);
+        if (other == 0)
+        {
+            dedup_link(handle);
+            continue;
+        }
+
+        frame = *DEDUP_REF(other)->ref;
+        page_get(frame);
+        at_set_merged(frame, 1);
+        page_put(*entry->ref);
+        *entry->ref = frame;
+        entry->state = DEDUP_MERGED;
+        dedup_nsaved++;
+        nmerged++;
+    }
+    dedup_cycles += rdtsc() - start;
+    return nmerged;
+}
+
+/**
+ * Fills in the number of registered references, of pages saved by merging,
+ * of pages hashed and of cycles spent by the scanner so far.
+ */
+void dedup_stats(struct dedup_stats *stats)
+{
+    stats->nrefs = dedup_nrefs;
+    stats->nsaved = dedup_nsaved;
+    stats->nscanned = dedup_nscanned;
+    stats->cycles = dedup_cycles;
+}
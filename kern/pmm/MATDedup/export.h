@@ -0,0 +1,17 @@
+#ifndef _KERN_PMM_MATDEDUP_H_
+#define _KERN_PMM_MATDEDUP_H_
+
+#ifdef _KERN_
+
+#include "stats.h"
+
+unsigned int dedup_register(unsigned int *ref);
+void dedup_unregister(unsigned int handle);
+unsigned int dedup_write(unsigned int handle);
+
+unsigned int dedup_scan(unsigned int nrefs);
+void dedup_stats(struct dedup_stats *stats);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATDEDUP_H_ */
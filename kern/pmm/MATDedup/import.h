@@ -0,0 +1,34 @@
+#ifndef _KERN_PMM_MATDEDUP_H_
+#define _KERN_PMM_MATDEDUP_H_
+
+#ifdef _KERN_
+
+/**
+ * The getter and setter functions implemented in the MATIntro layer.
+ */
+
+// The reference count of the page with the given index, 0 iff it is not allocated.
+unsigned int at_get_ref(unsigned int page_index);
+
+// Whether the allocated page is a frame shared by merged pages.
+unsigned int at_is_merged(unsigned int page_index);
+
+// Mark the allocated page as a frame shared by merged pages, or not.
+void at_set_merged(unsigned int page_index, unsigned int merged);
+
+/**
+ * The page allocator implemented in the MATOp layer.
+ */
+
+// Allocates a physical page, or returns 0 if there is none.
+unsigned int palloc(void);
+
+// Takes one more reference to an allocated page.
+void page_get(unsigned int page_index);
+
+// Drops a reference to a page, which is freed with the last one.
+void page_put(unsigned int page_index);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATDEDUP_H_ */
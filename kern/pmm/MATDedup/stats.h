@@ -0,0 +1,22 @@
+#ifndef _KERN_PMM_MATDEDUP_STATS_H_
+#define _KERN_PMM_MATDEDUP_STATS_H_
+
+#ifdef _KERN_
+
+#include <lib/types.h>
+
+/**
+ * The counters of dedup_stats. They have their own header, since MATDedup.c
+ * cannot include export.h next to its import.h.
+ */
+struct dedup_stats
+{
+    unsigned int nrefs;     // registered references
+    unsigned int nsaved;    // references merged into the frame of another one
+    unsigned int nscanned;  // pages hashed by the scanner
+    uint64_t cycles;        // cycles spent in the scanner
+};
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATDEDUP_STATS_H_ */
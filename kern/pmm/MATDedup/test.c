@@ -0,0 +1,156 @@
+#include <lib/debug.h>
+#include <lib/string.h>
+#include <pmm/MATIntro/export.h>
+#include <pmm/MATOp/export.h>
+#include "export.h"
+
+#define PAGESIZE 4096
+
+// More than the number of references the tests register.
+#define DEDUP_TEST_SCAN 4096
+
+static unsigned int test_page(unsigned int fill)
+{
+    unsigned int page_index = palloc();
+    if (page_index != 0)
+    {
+        memset((void *) (page_index * PAGESIZE), fill, PAGESIZE);
+    }
+    return page_index;
+}
+
+int MATDedup_test1()
+{
+    struct dedup_stats before, after;
+    unsigned int a, b, c;
+    unsigned int ha, hb, hc;
+    dedup_stats(&before);
+    a = test_page(0x5a);
+    b = test_page(0x5a);
+    c = test_page(0xa5);
+    ha = dedup_register(&a);
+    hb = dedup_register(&b);
+    hc = dedup_register(&c);
+    dedup_scan(DEDUP_TEST_SCAN);
+    dedup_stats(&after);
+    if (a != b || at_get_ref(a) != 2 || at_is_merged(a) != 1 || c == a)
+    {
+        dprintf("test 1.1 failed: pages %d, %d and %d not merged as expected\n", a, b, c);
+        return 1;
+    }
+    if (after.nsaved != before.nsaved + 1 || after.nrefs != before.nrefs + 3)
+    {
+        dprintf("test 1.2 failed: (%d != %d || %d != %d)\n", after.nsaved, before.nsaved + 1, after.nrefs, before.nrefs + 3);
+        return 1;
+    }
+    dedup_unregister(ha);
+    dedup_unregister(hb);
+    dedup_unregister(hc);
+    page_put(a);
+    page_put(b);
+    page_put(c);
+    if (at_is_allocated(a) != 0 || at_is_allocated(c) != 0)
+    {
+        dprintf("test 1.3 failed: pages %d and %d not freed\n", a, c);
+        return 1;
+    }
+    dprintf("test 1 passed.\n");
+    return 0;
+}
+
+int MATDedup_test2()
+{
+    struct dedup_stats before, after;
+    unsigned int a, b, page_index;
+    unsigned int ha, hb;
+    dedup_stats(&before);
+    a = test_page(0x3c);
+    b = test_page(0x3c);
+    ha = dedup_register(&a);
+    hb = dedup_register(&b);
+    dedup_scan(DEDUP_TEST_SCAN);
+    page_index = dedup_write(hb);
+    if (page_index != b || b == a || at_get_ref(a) != 1 || at_is_merged(a) != 0
+        || *(unsigned char *) (b * PAGESIZE) != 0x3c)
+    {
+        dprintf("test 2.1 failed: page %d not copied out of frame %d\n", b, a);
+        return 1;
+    }
+    dedup_stats(&after);
+    if (after.nsaved != before.nsaved)
+    {
+        dprintf("test 2.2 failed: (%d != %d)\n", after.nsaved, before.nsaved);
+        return 1;
+    }
+    dedup_unregister(ha);
+    dedup_unregister(hb);
+    page_put(a);
+    page_put(b);
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+int MATDedup_test3()
+{
+    struct dedup_stats before, after;
+    unsigned int a, b, c, d;
+    unsigned int ha, hb, hc, hd;
+    dedup_stats(&before);
+    a = test_page(0x11);
+    b = test_page(0x11);
+    c = test_page(0x11);
+    ha = dedup_register(&a);
+    hb = dedup_register(&b);
+    hc = dedup_register(&c);
+    dedup_scan(DEDUP_TEST_SCAN);
+    // the stable reference goes away, one of the merged ones takes its place
+    dedup_unregister(ha);
+    page_put(a);
+    d = test_page(0x11);
+    hd = dedup_register(&d);
+    dedup_scan(DEDUP_TEST_SCAN);
+    dedup_stats(&after);
+    if (b != c || d != b || at_get_ref(b) != 3 || after.nsaved != before.nsaved + 2)
+    {
+        dprintf("test 3.1 failed: (%d, %d, %d, ref %d, saved %d)\n", b, c, d, at_get_ref(b), after.nsaved - before.nsaved);
+        return 1;
+    }
+    dedup_unregister(hb);
+    dedup_unregister(hc);
+    dedup_unregister(hd);
+    page_put(b);
+    page_put(c);
+    page_put(d);
+    if (at_is_allocated(b) != 0)
+    {
+        dprintf("test 3.2 failed: page %d not freed\n", b);
+        return 1;
+    }
+    dprintf("test 3 passed.\n");
+    return 0;
+}
+
+/**
+ * Write Your Own Test Script (optional)
+ *
+ * Come up with your own interesting test cases to challenge your classmates!
+ * In addition to the provided simple tests, selected (correct and interesting) test functions
+ * will be used in the actual grading of the lab!
+ * Your test function itself will not be graded. So don't be afraid of submitting a wrong script.
+ *
+ * The test function should return 0 for passing the test and a non-zero code for failing the test.
+ * Be extra careful to make sure that if you overwrite some of the kernel data, they are set back to
+ * the original value. O.w., it may make the future test scripts to fail even if you implement all
+ * the functions correctly.
+ */
+int MATDedup_test_own()
+{
+    // TODO (optional)
+    // dprintf("own test passed.\n");
+    return 0;
+}
+
+int test_MATDedup()
+{
+    return MATDedup_test1() + MATDedup_test2() + MATDedup_test3() + MATDedup_test_own();
+}
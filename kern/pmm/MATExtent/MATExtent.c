@@ -0,0 +1,332 @@
+#include <lib/debug.h>
+#include <lib/gcc.h>
+#include <lib/queue.h>
+#include <lib/tree.h>
+#include <lib/types.h>
+
+/**
+ * The free-space manager keeps ranges of free physical pages as extents
+ * [start, start + len) of page indices, so that a large free region takes a
+ * single node no matter how many pages it has.
+ *
+ * Each extent is kept in two red-black trees at the same time:
+ *   extent_by_addr: ordered by the start index, for first-fit and
+ *     address-constrained lookup, and for finding the neighbours on free.
+ *   extent_by_size: ordered by the length, then by the start index,
+ *     for best-fit lookup.
+ * Extents never overlap or touch each other: a freed range is merged with
+ * all the extents it overlaps or is adjacent to.
+ *
+ * Page index 0 is never managed, so 0 is used as the "no extent" result.
+ */
+struct extent
+{
+    unsigned int start;
+    unsigned int len;
+    RB_ENTRY(extent) addr_link;
+    RB_ENTRY(extent) size_link;
+    SLIST_ENTRY(extent) free_link;
+};
+
+static int extent_addr_cmp(struct extent *a, struct extent *b)
+{
+    if (a->start != b->start)
+        return a->start < b->start ? -1 : 1;
+    return 0;
+}
+
+static int extent_size_cmp(struct extent *a, struct extent *b)
+{
+    if (a->len != b->len)
+        return a->len < b->len ? -1 : 1;
+    return extent_addr_cmp(a, b);
+}
+
+RB_HEAD(extent_addr_tree, extent);
+RB_HEAD(extent_size_tree, extent);
+
+RB_GENERATE_STATIC(extent_addr_tree, extent, addr_link, extent_addr_cmp)
+RB_GENERATE_STATIC(extent_size_tree, extent, size_link, extent_size_cmp)
+
+static struct extent_addr_tree extent_by_addr = RB_INITIALIZER(&extent_by_addr);
+static struct extent_size_tree extent_by_size = RB_INITIALIZER(&extent_by_size);
+
+/**
+ * The nodes are taken from a static pool, since there is no allocator below
+ * this layer. Nodes released by merges and allocations are recycled through
+ * extent_free_slots before new ones are taken from the pool.
+ */
+#define EXTENT_NSLOTS 1024
+
+static struct extent extent_slots[EXTENT_NSLOTS];
+static unsigned int extent_slots_next_free = 0;
+static SLIST_HEAD(, extent) extent_free_slots = SLIST_HEAD_INITIALIZER(extent_free_slots);
+
+static struct extent *extent_alloc_slot(void)
+{
+    struct extent *ext;
+
+    if (!SLIST_EMPTY(&extent_free_slots))
+    {
+        ext = SLIST_FIRST(&extent_free_slots);
+        SLIST_REMOVE_HEAD(&extent_free_slots, free_link);
+        return ext;
+    }
+    if (unlikely(extent_slots_next_free == EXTENT_NSLOTS))
+    {
+        return NULL;
+    }
+    return &extent_slots[extent_slots_next_free++];
+}
+
+static void extent_free_slot(struct extent *ext)
+{
+    SLIST_INSERT_HEAD(&extent_free_slots, ext, free_link);
+}
+
+static void extent_link(struct extent *ext)
+{
+    RB_INSERT(extent_addr_tree, &extent_by_addr, ext);
+    RB_INSERT(extent_size_tree, &extent_by_size, ext);
+}
+
+static void extent_unlink(struct extent *ext)
+{
+    RB_REMOVE(extent_addr_tree, &extent_by_addr, ext);
+    RB_REMOVE(extent_size_tree, &extent_by_size, ext);
+}
+
+/**
+ * Returns the extent with the highest start index not greater than
+ * the given page index, or NULL if there is none.
+ */
+static struct extent *extent_at_or_before(unsigned int page_index)
+{
+    struct extent key;
+    struct extent *ext;
+
+    key.start = page_index;
+    ext = RB_NFIND(extent_addr_tree, &extent_by_addr, &key);
+    if (ext == NULL)
+    {
+        return RB_MAX(extent_addr_tree, &extent_by_addr);
+    }
+    if (ext->start == page_index)
+    {
+        return ext;
+    }
+    return RB_PREV(extent_addr_tree, &extent_by_addr, ext);
+}
+
+/**
+ * Takes the pages [start, start + len) out of the given extent, which must
+ * contain them. Returns start, or 0 if the extent would have to be split
+ * and there is no free node left for the upper part.
+ */
+static unsigned int extent_carve(struct extent *ext, unsigned int start, unsigned int len)
+{
+    unsigned int end = ext->start + ext->len;
+    struct extent *rest = NULL;
+
+    if (start > ext->start && start + len < end)
+    {
+        rest = extent_alloc_slot();
+        if (rest == NULL)
+        {
+            return 0;
+        }
+    }
+
+    RB_REMOVE(extent_size_tree, &extent_by_size, ext);
+    if (start == ext->start)
+    {
+        if (len == ext->len)
+        {
+            RB_REMOVE(extent_addr_tree, &extent_by_addr, ext);
+            extent_free_slot(ext);
+            return start;
+        }
+        // the order by address does not change
+        ext->start += len;
+        ext->len -= len;
+        RB_INSERT(extent_size_tree, &extent_by_size, ext);
+        return start;
+    }
+
+    ext->len = start - ext->start;
+    RB_INSERT(extent_size_tree, &extent_by_size, ext);
+    if (rest != NULL)
+    {
+        rest->start = start + len;
+        rest->len = end - rest->start;
+        extent_link(rest);
+    }
+    return start;
+}
+
+/**
+ * Adds the pages [start, start + len) to the free set, merging them with
+ * every extent they overlap or are adjacent to, so that freeing a large
+ * region is a single operation on the trees.
+ * Returns 1 on success, or 0 if the range could not be recorded since
+ * all the nodes are in use.
+ */
+unsigned int extent_free(unsigned int start, unsigned int len)
+{
+    unsigned int end = start + len;
+    struct extent *ext;
+    struct extent *next;
+    struct extent *keep = NULL;
+
+    if (len == 0)
+    {
+        return 1;
+    }
+
+    ext = extent_at_or_before(start);
+    if (ext == NULL)
+    {
+        ext = RB_MIN(extent_addr_tree, &extent_by_addr);
+    }
+    else if (ext->start + ext->len < start)
+    {
+        ext = RB_NEXT(extent_addr_tree, &extent_by_addr, ext);
+    }
+
+    while (ext != NULL && ext->start <= end)
+    {
+        next = RB_NEXT(extent_addr_tree, &extent_by_addr, ext);
+        if (ext->start < start)
+        {
+            start = ext->start;
+        }
+        if (ext->start + ext->len > end)
+        {
+            end = ext->start + ext->len;
+        }
+        extent_unlink(ext);
+        if (keep == NULL)
+        {
+            keep = ext;
+        }
+        else
+        {
+            extent_free_slot(ext);
+        }
+        ext = next;
+    }
+
+    if (keep == NULL)
+    {
+        keep = extent_alloc_slot();
+        if (keep == NULL)
+        {
+            return 0;
+        }
+    }
+    keep->start = start;
+    keep->len = end - start;
+    extent_link(keep);
+    return 1;
+}
+
+/**
+ * Best-fit: takes len pages from the front of the shortest extent that has
+ * at least len pages. Returns the index of the first page, or 0 if there is
+ * no such extent.
+ */
+unsigned int extent_alloc_best(unsigned int len)
+{
+    struct extent key;
+    struct extent *ext;
+
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    key.start = 0;
+    key.len = len;
+    ext = RB_NFIND(extent_size_tree, &extent_by_size, &key);
+    if (ext == NULL)
+    {
+        return 0;
+    }
+    return extent_carve(ext, ext->start, len);
+}
+
+/**
+ * First-fit: takes len pages from the front of the lowest extent that has
+ * at least len pages. The extents are visited in address order.
+ * Returns the index of the first page, or 0 if there is no such extent.
+ */
+unsigned int extent_alloc_first(unsigned int len)
+{
+    struct extent *ext;
+
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    RB_FOREACH(ext, extent_addr_tree, &extent_by_addr)
+    {
+        if (ext->len >= len)
+        {
+            return extent_carve(ext, ext->start, len);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Address-constrained: takes the lowest len free pages [p, p + len) with
+ * lo <= p, p + len <= hi and p a multiple of align (align 0 is taken as 1).
+ * Returns p, or 0 if there is no such range.
+ */
+unsigned int extent_alloc_range(unsigned int lo, unsigned int hi,
+                                unsigned int len, unsigned int align)
+{
+    struct extent *ext;
+    unsigned int start;
+    unsigned int end;
+
+    if (len == 0 || lo >= hi || len > hi - lo)
+    {
+        return 0;
+    }
+    if (align == 0)
+    {
+        align = 1;
+    }
+
+    ext = extent_at_or_before(lo);
+    if (ext == NULL)
+    {
+        ext = RB_MIN(extent_addr_tree, &extent_by_addr);
+    }
+
+    while (ext != NULL && ext->start < hi)
+    {
+        start = ext->start > lo ? ext->start : lo;
+        start = (start + align - 1) / align * align;
+        end = ext->start + ext->len < hi ? ext->start + ext->len : hi;
+        if (start < end && len <= end - start)
+        {
+            return extent_carve(ext, start, len);
+        }
+        ext = RB_NEXT(extent_addr_tree, &extent_by_addr, ext);
+    }
+    return 0;
+}
+
+/**
+ * Drops all the extents and returns all the nodes to the pool.
+ */
+void extent_clear(void)
+{
+    RB_INIT(&extent_by_addr);
+    RB_INIT(&extent_by_size);
+    SLIST_INIT(&extent_free_slots);
+    extent_slots_next_free = 0;
+}
@@ -0,0 +1,15 @@
+#ifndef _KERN_PMM_MATEXTENT_H_
+#define _KERN_PMM_MATEXTENT_H_
+
+#ifdef _KERN_
+
+unsigned int extent_free(unsigned int start, unsigned int len);
+unsigned int extent_alloc_best(unsigned int len);
+unsigned int extent_alloc_first(unsigned int len);
+unsigned int extent_alloc_range(unsigned int lo, unsigned int hi,
+                                unsigned int len, unsigned int align);
+void extent_clear(void);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATEXTENT_H_ */
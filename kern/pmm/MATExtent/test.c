@@ -0,0 +1,100 @@
+#include <lib/debug.h>
+#include "export.h"
+
+/**
+ * The tests use the page indices [16, 32), which are reserved by the kernel
+ * and thus never in the free set, and take all of them out again at the end.
+ */
+
+int MATExtent_test1()
+{
+    unsigned int page_index;
+    if (extent_free(16, 8) != 1 || extent_free(24, 8) != 1)
+    {
+        dprintf("test 1.1 failed: (extent_free(16, 8) != 1 || extent_free(24, 8) != 1)\n");
+        extent_alloc_range(16, 32, 8, 1);
+        extent_alloc_range(16, 32, 8, 1);
+        return 1;
+    }
+    // the two extents are merged into [16, 32)
+    page_index = extent_alloc_range(16, 32, 16, 1);
+    if (page_index != 16)
+    {
+        dprintf("test 1.2 failed: (%d != 16)\n", page_index);
+        extent_alloc_range(16, 32, 8, 1);
+        extent_alloc_range(16, 32, 8, 1);
+        return 1;
+    }
+    if (extent_alloc_range(16, 32, 1, 1) != 0)
+    {
+        dprintf("test 1.3 failed: (extent_alloc_range(16, 32, 1, 1) != 0)\n");
+        return 1;
+    }
+    dprintf("test 1 passed.\n");
+    return 0;
+}
+
+int MATExtent_test2()
+{
+    unsigned int best;
+    unsigned int first;
+    extent_free(16, 4);
+    extent_free(24, 8);
+    best = extent_alloc_best(4);
+    first = extent_alloc_first(8);
+    if (best != 16 || first != 24)
+    {
+        dprintf("test 2.1 failed: (%d != 16 || %d != 24)\n", best, first);
+        while (extent_alloc_range(16, 32, 1, 1) != 0);
+        return 1;
+    }
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+int MATExtent_test3()
+{
+    unsigned int page_index;
+    extent_free(17, 15);
+    page_index = extent_alloc_range(16, 32, 8, 8);
+    if (page_index != 24)
+    {
+        dprintf("test 3.1 failed: (%d != 24)\n", page_index);
+        while (extent_alloc_range(16, 32, 1, 1) != 0);
+        return 1;
+    }
+    page_index = extent_alloc_range(16, 32, 7, 1);
+    if (page_index != 17)
+    {
+        dprintf("test 3.2 failed: (%d != 17)\n", page_index);
+        while (extent_alloc_range(16, 32, 1, 1) != 0);
+        return 1;
+    }
+    dprintf("test 3 passed.\n");
+    return 0;
+}
+
+/**
+ * Write Your Own Test Script (optional)
+ *
+ * Come up with your own interesting test cases to challenge your classmates!
+ * In addition to the provided simple tests, selected (correct and interesting) test functions
+ * will be used in the actual grading of the lab!
+ * Your test function itself will not be graded. So don't be afraid of submitting a wrong script.
+ *
+ * The test function should return 0 for passing the test and a non-zero code for failing the test.
+ * Be extra careful to make sure that if you overwrite some of the kernel data, they are set back to
+ * the original value. O.w., it may make the future test scripts to fail even if you implement all
+ * the functions correctly.
+ */
+int MATExtent_test_own()
+{
+    // TODO (optional)
+    // dprintf("own test passed.\n");
+    return 0;
+}
+
+int test_MATExtent()
+{
+    return MATExtent_test1() + MATExtent_test2() + MATExtent_test3() + MATExtent_test_own();
+}
@@ -0,0 +1,177 @@
+#include <lib/debug.h>
+#include <lib/gcc.h>
+#include <lib/string.h>
+#include <lib/types.h>
+#include "import.h"
+
+#define PAGESIZE 4096
+
+/**
+ * The kernel heap serves requests of any size.
+ *
+ * Small requests are rounded up to a size class and served by the slab cache
+ * of that class, so each class keeps its own free objects. The classes are the
+ * powers of two from 8 to 2048 bytes and the sizes halfway between them,
+ * so no more than a third of an object is lost to rounding past 16 bytes.
+ * The caches are created the first time their class is used. The slabs of
+ * the 1536 and 2048 byte classes span several pages, as a single page would
+ * hold only two or one of their objects after the slab header.
+ *
+ * Larger requests are served with whole contiguous pages from palloc_n.
+ * Such a block starts with a header holding its number of pages, whose
+ * first word is 0: the first word of a slab is its cache, so
+ * kmem_cache_of tells the two kinds of blocks apart.
+ */
+#define KMALLOC_ALIGN 8
+
+static const unsigned int kmalloc_sizes[] = {
+    8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+#define KMALLOC_NCLASSES (sizeof(kmalloc_sizes) / sizeof(kmalloc_sizes[0]))
+#define KMALLOC_MAX_SMALL 2048
+
+static struct kmem_cache *kmalloc_caches[KMALLOC_NCLASSES];
+
+struct kmalloc_large
+{
+    void *zero;
+    unsigned int npages;
+} gcc_aligned(16);
+
+/**
+ * Returns the cache of the smallest class with at least size bytes,
+ * creating it if needed, or NULL if it cannot be created.
+ */
+static struct kmem_cache *kmalloc_cache(unsigned int size)
+{
+    unsigned int i = 0;
+
+    while (kmalloc_sizes[i] < size)
+    {
+        i++;
+    }
+    if (kmalloc_caches[i] == NULL)
+    {
+        kmalloc_caches[i] = kmem_cache_create(kmalloc_sizes[i], KMALLOC_ALIGN);
+    }
+    return kmalloc_caches[i];
+}
+
+/**
+ * Returns the number of bytes usable in the block allocated by kmalloc.
+ */
+static unsigned int kmalloc_capacity(void *ptr)
+{
+    struct kmem_cache *cache = kmem_cache_of(ptr);
+    struct kmalloc_large *large;
+
+    if (cache != NULL)
+    {
+        return kmem_cache_size(cache);
+    }
+    large = (struct kmalloc_large *) ptr - 1;
+    return large->npages * PAGESIZE - sizeof(struct kmalloc_large);
+}
+
+/**
+ * Allocates size bytes, aligned to 8 bytes.
+ * Returns NULL if size is 0 or there is no memory left.
+ */
+void *kmalloc(unsigned int size)
+{
+    struct kmem_cache *cache;
+    struct kmalloc_large *large;
+    unsigned int npages;
+    unsigned int page_index;
+
+    if (size == 0)
+    {
+        return NULL;
+    }
+
+    if (size <= KMALLOC_MAX_SMALL)
+    {
+        cache = kmalloc_cache(size);
+        if (cache == NULL)
+        {
+            return NULL;
+        }
+        return kmem_cache_alloc(cache);
+    }
+
+    if (size > 0xffffffff - sizeof(struct kmalloc_large) - PAGESIZE)
+    {
+        return NULL;
+    }
+    npages = (size + sizeof(struct kmalloc_large) + PAGESIZE - 1) / PAGESIZE;
+    page_index = palloc_n_owner(npages, OWNER_HEAP);
+    if (page_index == 0)
+    {
+        return NULL;
+    }
+    large = (struct kmalloc_large *) (page_index * PAGESIZE);
+    large->zero = NULL;
+    large->npages = npages;
+    return large + 1;
+}
+
+/**
+ * Frees a block allocated by kmalloc or krealloc. Does nothing for NULL.
+ */
+void kfree(void *ptr)
+{
+    struct kmem_cache *cache;
+    struct kmalloc_large *large;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    cache = kmem_cache_of(ptr);
+    if (cache != NULL)
+    {
+        kmem_cache_free(cache, ptr);
+        return;
+    }
+    large = (struct kmalloc_large *) ptr - 1;
+    pfree_n((uintptr_t) large / PAGESIZE, large->npages);
+}
+
+/**
+ * Resizes a block allocated by kmalloc to size bytes, keeping its contents.
+ * The block is kept in place if it is already large enough, otherwise it is
+ * moved to a new block. krealloc(NULL, size) is kmalloc(size), and
+ * krealloc(ptr, 0) frees the block and returns NULL.
+ * Returns NULL, leaving the block untouched, if there is no memory left.
+ */
+void *krealloc(void *ptr, unsigned int size)
+{
+    unsigned int capacity;
+    void *new_ptr;
+
+    if (ptr == NULL)
+    {
+        return kmalloc(size);
+    }
+    if (size == 0)
+    {
+        kfree(ptr);
+        return NULL;
+    }
+
+    capacity = kmalloc_capacity(ptr);
+    if (size <= capacity)
+    {
+        return ptr;
+    }
+    new_ptr = kmalloc(size);
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, capacity);
+    kfree(ptr);
+    return new_ptr;
+}
@@ -0,0 +1,124 @@
+#include <lib/debug.h>
+#include <lib/types.h>
+#include <lib/x86.h>
+#include <pmm/MATOp/export.h>
+#include "export.h"
+
+/**
+ * Benchmarks of the kernel heap against one page per object from palloc,
+ * run at boot when the kernel is built with BENCH=1.
+ */
+
+#define PAGESIZE 4096
+
+// Number of live objects in each benchmark.
+#define BENCH_NOBJS 1024
+
+// Number of times the objects are allocated and freed.
+#define BENCH_ROUNDS 8
+
+static void *bench_objs[BENCH_NOBJS];
+static unsigned int bench_pages[BENCH_NOBJS];
+
+/**
+ * The size of the i-th object: a mix of small sizes, up to 1000 bytes.
+ */
+static unsigned int bench_size(unsigned int i)
+{
+    return 8 + (i * 37) % 993;
+}
+
+/**
+ * Returns the number of distinct pages among the pages of the objects.
+ */
+static unsigned int bench_distinct_pages(void)
+{
+    unsigned int i, j;
+    unsigned int page;
+    unsigned int n = 0;
+
+    for (i = 0; i < BENCH_NOBJS; i++)
+    {
+        page = (uintptr_t) bench_objs[i] / PAGESIZE;
+        for (j = 0; j < n && bench_pages[j] != page; j++)
+            ;
+        if (j == n)
+        {
+            bench_pages[n++] = page;
+        }
+    }
+    return n;
+}
+
+static void bench_kmalloc(unsigned int requested)
+{
+    unsigned int round;
+    unsigned int i;
+    unsigned int npages;
+    uint64_t start;
+
+    start = rdtsc();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_NOBJS; i++)
+        {
+            bench_objs[i] = kmalloc(bench_size(i));
+        }
+        for (i = 0; i < BENCH_NOBJS; i++)
+        {
+            kfree(bench_objs[i]);
+        }
+    }
+    dprintf("  kmalloc/kfree: %u cycles per pair\n",
+            (unsigned int) (rdtsc() - start) / (BENCH_NOBJS * BENCH_ROUNDS));
+
+    // one more round, untimed, to count the pages the objects take
+    for (i = 0; i < BENCH_NOBJS; i++)
+    {
+        bench_objs[i] = kmalloc(bench_size(i));
+    }
+    npages = bench_distinct_pages();
+    for (i = 0; i < BENCH_NOBJS; i++)
+    {
+        kfree(bench_objs[i]);
+    }
+    dprintf("    %u pages for %u bytes, %u%% used\n",
+            npages, requested, requested / (npages * (PAGESIZE / 100)));
+}
+
+static void bench_palloc(unsigned int requested)
+{
+    unsigned int round;
+    unsigned int i;
+    uint64_t start;
+
+    start = rdtsc();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (i = 0; i < BENCH_NOBJS; i++)
+        {
+            bench_pages[i] = palloc();
+        }
+        for (i = 0; i < BENCH_NOBJS; i++)
+        {
+            pfree(bench_pages[i]);
+        }
+    }
+    dprintf("  palloc/pfree: %u cycles per pair\n",
+            (unsigned int) (rdtsc() - start) / (BENCH_NOBJS * BENCH_ROUNDS));
+    dprintf("    %u pages for %u bytes, %u%% used\n",
+            BENCH_NOBJS, requested, requested / (BENCH_NOBJS * (PAGESIZE / 100)));
+}
+
+void bench_MATHeap(void)
+{
+    unsigned int requested = 0;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_NOBJS; i++)
+    {
+        requested += bench_size(i);
+    }
+    bench_kmalloc(requested);
+    bench_palloc(requested);
+}
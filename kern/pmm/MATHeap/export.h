@@ -0,0 +1,12 @@
+#ifndef _KERN_PMM_MATHEAP_H_
+#define _KERN_PMM_MATHEAP_H_
+
+#ifdef _KERN_
+
+void *kmalloc(unsigned int size);
+void kfree(void *ptr);
+void *krealloc(void *ptr, unsigned int size);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATHEAP_H_ */
@@ -0,0 +1,43 @@
+#ifndef _KERN_PMM_MATHEAP_H_
+#define _KERN_PMM_MATHEAP_H_
+
+#ifdef _KERN_
+
+/**
+ * The contiguous page allocator implemented in the MATOp layer.
+ */
+
+// The owner tag of the pages of large blocks.
+#define OWNER_HEAP 2
+
+// Allocates n physically contiguous pages tagged with the owner,
+// or returns 0 if there are none.
+unsigned int palloc_n_owner(unsigned int n, unsigned int owner);
+
+// Frees n physically contiguous pages allocated by palloc_n.
+void pfree_n(unsigned int pfree_index, unsigned int n);
+
+/**
+ * The object caches implemented in the MATSlab layer.
+ */
+
+struct kmem_cache;
+
+// Creates a cache of objects of the given size and alignment, or returns NULL.
+struct kmem_cache *kmem_cache_create(unsigned int size, unsigned int align);
+
+// Allocates an object from the cache, or returns NULL.
+void *kmem_cache_alloc(struct kmem_cache *cache);
+
+// Frees an object allocated from the cache.
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+// The cache of an object, read from the first word of its page.
+struct kmem_cache *kmem_cache_of(void *obj);
+
+// The size of the objects of the cache.
+unsigned int kmem_cache_size(struct kmem_cache *cache);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATHEAP_H_ */
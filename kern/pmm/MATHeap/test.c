@@ -0,0 +1,107 @@
+#include <lib/debug.h>
+#include <lib/types.h>
+#include <pmm/MATIntro/export.h>
+#include "export.h"
+
+#define PAGESIZE 4096
+
+int MATHeap_test1()
+{
+    unsigned char *small = kmalloc(100);
+    unsigned char *large = kmalloc(3 * PAGESIZE);
+    unsigned int i;
+    if (small == NULL || large == NULL || (uintptr_t) small % 8 != 0 || (uintptr_t) large % 8 != 0)
+    {
+        dprintf("test 1.1 failed: (%p == NULL || %p == NULL)\n", small, large);
+        kfree(small);
+        kfree(large);
+        return 1;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        if (at_is_allocated((uintptr_t) large / PAGESIZE + i) != 1)
+        {
+            dprintf("test 1.2 failed (i = %d): (%d != 1)\n", i, at_is_allocated((uintptr_t) large / PAGESIZE + i));
+            kfree(small);
+            kfree(large);
+            return 1;
+        }
+    }
+    kfree(large);
+    if (at_is_allocated((uintptr_t) large / PAGESIZE + 3) != 0)
+    {
+        dprintf("test 1.3 failed: (%d != 0)\n", at_is_allocated((uintptr_t) large / PAGESIZE + 3));
+        kfree(small);
+        return 1;
+    }
+    kfree(small);
+    if (kmalloc(0) != NULL)
+    {
+        dprintf("test 1.4 failed: (kmalloc(0) != NULL)\n");
+        return 1;
+    }
+    kfree(NULL);
+    dprintf("test 1 passed.\n");
+    return 0;
+}
+
+int MATHeap_test2()
+{
+    unsigned char *ptr = kmalloc(20);
+    unsigned char *old;
+    unsigned int i;
+    for (i = 0; i < 20; i++)
+    {
+        ptr[i] = i;
+    }
+    old = ptr;
+    ptr = krealloc(ptr, 24);
+    if (ptr != old)
+    {
+        dprintf("test 2.1 failed: the block was moved within its size class\n");
+        kfree(ptr);
+        return 1;
+    }
+    ptr = krealloc(ptr, 5000);
+    for (i = 0; i < 20; i++)
+    {
+        if (ptr == NULL || ptr[i] != i)
+        {
+            dprintf("test 2.2 failed (i = %d): the contents were not kept\n", i);
+            kfree(ptr);
+            return 1;
+        }
+    }
+    if (krealloc(ptr, 0) != NULL)
+    {
+        dprintf("test 2.3 failed: (krealloc(ptr, 0) != NULL)\n");
+        return 1;
+    }
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+/**
+ * Write Your Own Test Script (optional)
+ *
+ * Come up with your own interesting test cases to challenge your classmates!
+ * In addition to the provided simple tests, selected (correct and interesting) test functions
+ * will be used in the actual grading of the lab!
+ * Your test function itself will not be graded. So don't be afraid of submitting a wrong script.
+ *
+ * The test function should return 0 for passing the test and a non-zero code for failing the test.
+ * Be extra careful to make sure that if you overwrite some of the kernel data, they are set back to
+ * the original value. O.w., it may make the future test scripts to fail even if you implement all
+ * the functions correctly.
+ */
+int MATHeap_test_own()
+{
+    // TODO (optional)
+    // dprintf("own test passed.\n");
+    return 0;
+}
+
+int test_MATHeap()
+{
+    return MATHeap_test1() + MATHeap_test2() + MATHeap_test_own();
+}
@@ -7,6 +7,71 @@
 #define VM_USERLO_PI (VM_USERLO / PAGESIZE)
 #define VM_USERHI_PI (VM_USERHI / PAGESIZE)
 
+/**
+ * Boot-time bump allocator for the tables of the physical memory manager.
+ *
+ * The memory is taken right after the kernel image, from the usable range
+ * of the memory map that contains it, or from the next usable range with
+ * enough room. Only memory below VM_USERLO is used, whose pages are kernel
+ * only and thus never handed out by the allocators. It is never freed.
+ */
+static unsigned int boot_next = 0;
+static unsigned int boot_limit = 0;
+
+static unsigned int boot_alloc(unsigned int size)
+{
+    extern char end[];
+    unsigned int addr;
+    unsigned int entry_start;
+    unsigned int entry_end;
+
+    size = (size + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+    if (boot_next == 0)
+    {
+        boot_next = ((unsigned int) end + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+        boot_limit = boot_next;
+    }
+
+    if (boot_limit - boot_next < size)
+    {
+        for (unsigned int i = 0; i < get_size(); i++)
+        {
+            if (!is_usable(i) || get_mml(i) == 0)
+            {
+                continue;
+            }
+            entry_start = get_mms(i);
+            entry_end = entry_start + get_mml(i) - 1;
+            addr = entry_start > boot_next ? entry_start : boot_next;
+            addr = (addr + PAGESIZE - 1) / PAGESIZE * PAGESIZE;
+            entry_end = entry_end < VM_USERLO - 1 ? entry_end : VM_USERLO - 1;
+            if (addr <= entry_end && size <= (entry_end + 1) / PAGESIZE * PAGESIZE - addr)
+            {
+                boot_next = addr;
+                boot_limit = (entry_end + 1) / PAGESIZE * PAGESIZE;
+                break;
+            }
+        }
+        if (boot_limit - boot_next < size)
+        {
+            KERN_PANIC("No usable memory for %u bytes of boot-time tables.\n", size);
+        }
+    }
+
+    addr = boot_next;
+    boot_next += size;
+    return addr;
+}
+
+/**
+ * The usable ranges of the memory map, in pages, sorted by the first page.
+ * The memory map has no more than 128 entries (see dev/mboot.c).
+ */
+#define MAX_USABLE_RANGES 128
+
+static unsigned int usable_first[MAX_USABLE_RANGES];
+static unsigned int usable_last[MAX_USABLE_RANGES];
+
 /**
  * The initialization function for the allocation table AT.
  * It contains two major parts:
@@ -23,12 +88,16 @@ void pmem_init(unsigned int mbi_addr)
 
     unsigned int table_size;
     unsigned int highest_addr;
-    unsigned int page_start;
-    unsigned int page_end;
     unsigned int entry_start;
     unsigned int entry_end;
-    unsigned int page_idx;
     unsigned int entry_end_addr;
+    unsigned int first_page;
+    unsigned int last_page;
+    unsigned int at_pages;
+    unsigned int nranges;
+    unsigned int run_first;
+    unsigned int run_last;
+    unsigned int j;
 
     // Calls the lower layer initialization primitive.
     // The parameter mbi_addr should not be used in the further code.
@@ -66,6 +135,57 @@ void pmem_init(unsigned int mbi_addr)
 
     set_nps(nps); // Setting the value computed above to NUM_PAGES.
 
+    /**
+     * Collects the whole pages [first, last) of each usable range of the memory map,
+     * sorted by the first page. The ranges are not aligned by pages, and partial
+     * pages are not used, so the page-aligned part of each range is taken.
+     */
+    nranges = 0;
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        if (!is_usable(i) || get_mml(i) == 0)
+        {
+            continue;
+        }
+        entry_start = get_mms(i);
+        entry_end = entry_start + get_mml(i) - 1;
+        first_page = entry_start / PAGESIZE + (entry_start % PAGESIZE > 0);
+        last_page = entry_end / PAGESIZE + (entry_end % PAGESIZE == PAGESIZE - 1);
+        if (first_page >= last_page || nranges == MAX_USABLE_RANGES)
+        {
+            continue;
+        }
+
+        j = nranges++;
+        while (j > 0 && usable_first[j - 1] > first_page)
+        {
+            usable_first[j] = usable_first[j - 1];
+            usable_last[j] = usable_last[j - 1];
+            j--;
+        }
+        usable_first[j] = first_page;
+        usable_last[j] = last_page;
+    }
+
+    /**
+     * The AT only has to cover the pages up to the end of the highest usable
+     * range, since the pages above it are never normal. Its tables are taken
+     * with the boot-time bump allocator instead of being sized for 4GB in the BSS.
+     */
+    at_pages = 0;
+    for (unsigned int i = 0; i < nranges; i++)
+    {
+        if (usable_last[i] > at_pages)
+        {
+            at_pages = usable_last[i];
+        }
+    }
+    if (at_pages > nps)
+    {
+        at_pages = nps;
+    }
+    at_init(boot_alloc(at_table_size(at_pages)), at_pages);
+
     /**
      * Initialization of the physical allocation table (AT).
      *
@@ -90,54 +210,45 @@ void pmem_init(unsigned int mbi_addr)
      *    so in that case, you should consider those pages as unavailable.
      */
 
-    //iterate over all pages
-    for (unsigned int i = 0; i < nps; i++)
-    {
-        if (i < VM_USERLO_PI || i >= VM_USERHI_PI)
-        {
-            at_set_perm(i, 1);
-        }
-        else
-        {
-            at_set_perm(i, 0);
-        }
-    }
+    // at_init leaves all the pages reserved (0), so only the kernel pages are set.
+    at_set_perm_range(0, VM_USERLO_PI, 1);
+    at_set_perm_range(VM_USERHI_PI, at_pages, 1);
 
-    //iterate over each entry in the physical memory table
-    for (unsigned int i = 0; i < table_size; i++)
+    /**
+     * Sweeps the sorted usable ranges, merging the ones that overlap or touch,
+     * and marks the part of each merged range in [VM_USERLO, VM_USERHI) as normal
+     * with one range fill (with ENABLE_PMM_FREELIST, this also puts its pages on
+     * the free list). The same part is recorded as one free extent.
+     */
+    run_first = 0;
+    run_last = 0;
+    for (unsigned int i = 0; i <= nranges; i++)
     {
-
-        //get the length of each physical memory entry
-        entry_start = get_mms(i);
-        entry_end = entry_start + get_mml(i) - 1;
-
-        //see how many pages can fit in an entry
-        //also be ware since highest_addr + 1 = 0 (overflow for unsigned int)
-        for (unsigned int page_start = entry_start; page_start <= entry_end - PAGESIZE + 1; page_start += PAGESIZE)
+        if (i < nranges && usable_first[i] <= run_last)
         {
-
-            //get page idx and align to beginning of page
-            page_idx = page_start / PAGESIZE;
-            if (page_start % PAGESIZE > 0)
+            if (usable_last[i] > run_last)
             {
-                page_idx++;
+                run_last = usable_last[i];
             }
+            continue;
+        }
 
-            //change page_start to start of page
-            page_start = page_idx * PAGESIZE;
-            page_end = page_start + PAGESIZE - 1;
-
-            //change permission for that page
-            if (VM_USERLO_PI <= page_idx && page_idx < VM_USERHI_PI &&
-                is_usable(i))
-            {
-                at_set_perm(page_idx, 2);
-            }
+        first_page = run_first > VM_USERLO_PI ? run_first : VM_USERLO_PI;
+        last_page = run_last < VM_USERHI_PI ? run_last : VM_USERHI_PI;
+        if (last_page > at_pages)
+        {
+            last_page = at_pages;
+        }
+        if (first_page < last_page)
+        {
+            at_set_perm_range(first_page, last_page, 2);
+            extent_free(first_page, last_page - first_page);
+        }
 
-            if (page_start + PAGESIZE <= page_start)
-            {
-                break;
-            }
+        if (i < nranges)
+        {
+            run_first = usable_first[i];
+            run_last = usable_last[i];
         }
     }
 }
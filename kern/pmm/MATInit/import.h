@@ -8,8 +8,20 @@
  */
 // Sets the number of available pages.
 void set_nps(unsigned int nps);
+// The number of bytes taken by the AT covering the given number of pages.
+unsigned int at_table_size(unsigned int npages);
+// Lays out the AT covering the given number of pages at the given address.
+void at_init(unsigned int table_addr, unsigned int npages);
 // Sets the permission of the physical page with given index.
 void at_set_perm(unsigned int page_index, unsigned int perm);
+// Sets the permission of the physical pages [lo, hi).
+void at_set_perm_range(unsigned int lo, unsigned int hi, unsigned int perm);
+
+/**
+ * The free-space manager implemented in the MATExtent layer.
+ */
+// Adds the pages [start, start + len) to the free extents.
+unsigned int extent_free(unsigned int start, unsigned int len);
 
 /**
  * Getter and setter functions for the physical memory map table.
@@ -1,5 +1,7 @@
 #include <lib/debug.h>
+#include <lib/types.h>
 #include <pmm/MATIntro/export.h>
+#include "import.h"
 
 #define PAGESIZE     4096
 #define VM_USERLO    0x40000000
@@ -30,6 +32,121 @@ int MATInit_test1()
     return 0;
 }
 
+int MATInit_test2()
+{
+    extern uint8_t start[], end[];
+    unsigned int addr = at_table_addr();
+    unsigned int npages = at_table_npages();
+    unsigned int size = at_table_size(npages);
+    unsigned int i;
+    // the tables lie below VM_USERLO, in a single usable range of the memory map
+    if (addr == 0 || npages == 0 || addr + size > VM_USERLO)
+    {
+        dprintf("test 2.1 failed: tables of %d bytes at %x\n", size, addr);
+        return 1;
+    }
+    for (i = 0; i < get_size(); i++)
+    {
+        if (is_usable(i) && get_mms(i) <= addr && addr + size - get_mms(i) <= get_mml(i))
+        {
+            break;
+        }
+    }
+    if (i == get_size())
+    {
+        dprintf("test 2.2 failed: tables at [%x, %x) not in a usable range\n", addr, addr + size);
+        return 1;
+    }
+    // they do not overlap the kernel image
+    if (addr < (unsigned int) end && addr + size > (unsigned int) start)
+    {
+        dprintf("test 2.3 failed: tables at [%x, %x) overlap the kernel [%x, %x)\n",
+                addr, addr + size, (unsigned int) start, (unsigned int) end);
+        return 1;
+    }
+    // the pages past the tables read as reserved and unallocated, whatever is set
+    at_set_perm(npages, 2);
+    at_set_allocated_range(npages, npages + 1, 1);
+    for (i = npages; i < npages + 1024 && i < (1 << 20); i++)
+    {
+        if (at_is_norm(i) != 0 || at_is_allocated(i) != 0)
+        {
+            dprintf("test 2.4 failed (i = %d): page past the tables is set\n", i);
+            return 1;
+        }
+    }
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+/**
+ * Returns 1 if the page should be normal: it is in the user range,
+ * covered by the tables, and one usable range of the memory map
+ * contains the whole page.
+ */
+static unsigned int test_usable(unsigned int page_index)
+{
+    unsigned long long addr = (unsigned long long) page_index * PAGESIZE;
+    unsigned int i;
+
+    if (page_index < VM_USERLO_PI || page_index >= VM_USERHI_PI || page_index >= at_table_npages())
+    {
+        return 0;
+    }
+    for (i = 0; i < get_size(); i++)
+    {
+        if (is_usable(i) && get_mms(i) <= addr
+            && addr + PAGESIZE <= (unsigned long long) get_mms(i) + get_mml(i))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int MATInit_test3()
+{
+    unsigned int edges[2];
+    unsigned int page_index;
+    unsigned int i, j;
+    // the sweep over the merged ranges marks the pages at the edges of each
+    // usable range as the page-by-page definition does, where ranges touch,
+    // overlap, or do not start or end on a page boundary
+    for (i = 0; i < get_size(); i++)
+    {
+        if (!is_usable(i) || get_mml(i) == 0)
+        {
+            continue;
+        }
+        edges[0] = get_mms(i) / PAGESIZE;
+        edges[1] = (unsigned int) (((unsigned long long) get_mms(i) + get_mml(i) - 1) / PAGESIZE);
+        for (j = 0; j < 2; j++)
+        {
+            for (page_index = edges[j] > 0 ? edges[j] - 1 : 0; page_index <= edges[j] + 1; page_index++)
+            {
+                if (at_is_norm(page_index) != test_usable(page_index))
+                {
+                    dprintf("test 3.1 failed (range %d, page %d): (%d != %d)\n",
+                            i, page_index, at_is_norm(page_index), test_usable(page_index));
+                    return 1;
+                }
+            }
+        }
+    }
+    // an empty or inverted range is left alone
+    page_index = VM_USERLO_PI;
+    j = at_is_norm(page_index);
+    at_set_perm_range(page_index + 1, page_index, 0);
+    at_set_perm_range(page_index, page_index, 0);
+    if (at_is_norm(page_index) != j)
+    {
+        dprintf("test 3.2 failed: an empty range changed page %d\n", page_index);
+        return 1;
+    }
+    dprintf("test 3 passed.\n");
+    return 0;
+}
+
 /**
  * Write Your Own Test Script (optional)
  *
@@ -52,5 +169,5 @@ int MATInit_test_own()
 
 int test_MATInit()
 {
-    return MATInit_test1() + MATInit_test_own();
+    return MATInit_test1() + MATInit_test2() + MATInit_test3() + MATInit_test_own();
 }
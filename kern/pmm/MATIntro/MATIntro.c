@@ -1,34 +1,324 @@
 #include <lib/gcc.h>
+#include <lib/string.h>
 
 // Number of physical pages that are actually available in the machine.
 static unsigned int NUM_PAGES;
 
 /**
- * Structure representing information for one physical page.
+ * A 32 bit machine may have up to 4GB of memory.
+ * So it may have up to 2^20 physical pages,
+ * with the page size being 4KB.
+ */
+#define AT_MAX_PAGES (1 << 20)
+#define AT_WORD_BITS 32
+
+// Number of words of 32 bits needed for the given number of bits.
+#define AT_NWORDS(nbits) (((nbits) + AT_WORD_BITS - 1) / AT_WORD_BITS)
+
+/**
+ * The allocation table (AT) keeps a one-byte descriptor per page, so that
+ * 64 pages share a cache line instead of 8 with a structure of two ints.
+ *
+ * AT_desc: the descriptor of each page.
+ *   bits 0-1: the permission of the page.
+ *     0: Reserved by the BIOS.
+ *     1: Kernel only.
+ *     2: Normal (available).
+ *   bit 2: the allocation flag, set iff the reference count is not 0.
+ *   bit 3: the cache flag: the page is unallocated, but held in the page
+ *     cache of a CPU, so it is not handed out from the AT.
+ *   bit 4: the merged flag: the page is allocated, and its frame is shared
+ *     read-only by the pages merged into it by MATDedup.
+ *     It is cleared whenever the page becomes allocated again.
+ *   bits 5-7: spare, for per-page flags of the layers above.
+ * AT_ref: the reference count of each page, for pages shared by several users,
+ *   in one byte, see AT_spill for larger counts. It is kept apart from the
+ *   descriptors, so that scans over them stay dense.
+ * AT_owner: the owner tag of each allocated page, see at_set_owner.
+ *   At one byte per page, it costs 512KB for a 2GB machine, see at_table_size.
+ * AT_free: 1 bit per page, set iff the page is normal, unallocated and not cached.
+ *   It is derived from the descriptors and kept up to date by the setters,
+ *   so that the allocator can test 32 pages with one load.
+ *
+ * The tables only cover the pages [0, AT_npages). They are not static:
+ * at_init lays them out in memory given by pmem_init, sized to the number
+ * of pages of the machine. The pages not covered read as reserved and
+ * unallocated, and setting them has no effect.
+ */
+#define AT_PERM_MASK 0x03
+#define AT_ALLOCATED 0x04
+#define AT_CACHED    0x08
+#define AT_MERGED    0x10
+
+#define AT_MAX_REF 0xffff
+
+static unsigned int AT_npages;
+static unsigned char *AT_desc;
+static unsigned char *AT_ref;
+static unsigned char *AT_owner;
+static unsigned int *AT_free;
+
+/**
+ * Per-owner accounting: every allocated page has an owner tag, 0 until it is
+ * set by at_set_owner, and the number of allocated pages of each owner and its
+ * highest value so far are kept up to date by the setters, whenever a page
+ * becomes allocated or unallocated.
  */
-struct ATStruct
+#define AT_NUM_OWNERS 256
+
+static unsigned int AT_owner_live[AT_NUM_OWNERS];
+static unsigned int AT_owner_peak[AT_NUM_OWNERS];
+
+static gcc_inline void at_owner_add(unsigned int owner, unsigned int npages)
+{
+    AT_owner_live[owner] += npages;
+    if (AT_owner_live[owner] > AT_owner_peak[owner])
+    {
+        AT_owner_peak[owner] = AT_owner_live[owner];
+    }
+}
+
+/**
+ * A reference count that does not fit in the byte of AT_ref, from AT_REF_SPILL
+ * up, is kept in AT_spill, with the byte set to AT_REF_SPILL. Few pages ever
+ * have that many users, so a short table searched linearly is enough. When it
+ * is full, a larger count saturates instead: the byte is AT_REF_SPILL with no
+ * entry, which reads as AT_MAX_REF, as does a count set past AT_MAX_REF.
+ */
+#define AT_REF_SPILL 0xff
+#define AT_NSPILL    32
+
+struct at_spill
 {
-    /**
-     * The permission of the page.
-     * 0: Reserved by the BIOS.
-     * 1: Kernel only.
-     * >1: Normal (available).
-     */
-    unsigned int perm;
-    /**
-     * Whether the page is allocated.
-     * 0: unallocated
-     * >0: allocated
-     */
-    unsigned int allocated;
+    unsigned int page_index;
+    unsigned int ref;
 };
 
+static struct at_spill AT_spill[AT_NSPILL];
+static unsigned int AT_nspill;
+
+static struct at_spill *at_spill_find(unsigned int page_index)
+{
+    unsigned int i;
+
+    for (i = 0; i < AT_nspill; i++)
+    {
+        if (AT_spill[i].page_index == page_index)
+        {
+            return &AT_spill[i];
+        }
+    }
+    return NULL;
+}
+
 /**
- * A 32 bit machine may have up to 4GB of memory.
- * So it may have up to 2^20 physical pages,
- * with the page size being 4KB.
+ * Stores the reference count of the page, at most AT_MAX_REF,
+ * in AT_ref or in AT_spill.
+ */
+static void at_ref_spill(unsigned int page_index, unsigned int ref)
+{
+    struct at_spill *spill = NULL;
+
+    if (AT_ref[page_index] == AT_REF_SPILL)
+    {
+        spill = at_spill_find(page_index);
+    }
+    if (spill != NULL && (ref < AT_REF_SPILL || ref == AT_MAX_REF))
+    {
+        *spill = AT_spill[--AT_nspill];
+        spill = NULL;
+    }
+    if (ref < AT_REF_SPILL)
+    {
+        AT_ref[page_index] = ref;
+        return;
+    }
+
+    AT_ref[page_index] = AT_REF_SPILL;
+    if (ref == AT_MAX_REF)
+    {
+        return;
+    }
+    if (spill == NULL)
+    {
+        if (AT_nspill == AT_NSPILL)
+        {
+            return;
+        }
+        spill = &AT_spill[AT_nspill++];
+        spill->page_index = page_index;
+    }
+    spill->ref = ref;
+}
+
+static gcc_inline void at_ref_store(unsigned int page_index, unsigned int ref)
+{
+    if (ref < AT_REF_SPILL && AT_ref[page_index] != AT_REF_SPILL)
+    {
+        AT_ref[page_index] = ref;
+    }
+    else
+    {
+        at_ref_spill(page_index, ref);
+    }
+}
+
+/**
+ * The number of bits set in AT_free, and the number of pages with the cache
+ * flag, so that the allocator can check how much memory is left in constant time.
+ */
+static unsigned int AT_nfree;
+static unsigned int AT_ncached;
+
+/**
+ * Two levels of summary over AT_free, so that a free page can be found
+ * without walking long runs of fully allocated words.
+ *
+ * AT_summary: bit w is set iff AT_free[w] is non-zero.
+ * AT_top: bit s is set iff AT_summary[s] is non-zero.
+ */
+static unsigned int AT_nwords;
+static unsigned int AT_nsummary;
+static unsigned int AT_ntop;
+
+static unsigned int *AT_summary;
+static unsigned int *AT_top;
+
+#ifdef ENABLE_PMM_FREELIST
+
+#define PAGESIZE 4096
+
+/**
+ * The free list: all the normal and unallocated pages are kept on a doubly
+ * linked list, which is updated by the setters together with AT_free.
+ * The links of a page are stored at the beginning of the free page itself,
+ * and a link value of AT_MAX_PAGES means the end of the list.
  */
-static struct ATStruct AT[1 << 20];
+struct at_link
+{
+    unsigned int prev;
+    unsigned int next;
+};
+
+#define AT_LINK(page_index) ((struct at_link *) ((page_index) * PAGESIZE))
+
+static unsigned int AT_free_head = AT_MAX_PAGES;
+
+static void at_list_push(unsigned int page_index)
+{
+    struct at_link *link = AT_LINK(page_index);
+
+    link->prev = AT_MAX_PAGES;
+    link->next = AT_free_head;
+    if (AT_free_head != AT_MAX_PAGES)
+    {
+        AT_LINK(AT_free_head)->prev = page_index;
+    }
+    AT_free_head = page_index;
+}
+
+static void at_list_remove(unsigned int page_index)
+{
+    struct at_link *link = AT_LINK(page_index);
+
+    if (link->prev != AT_MAX_PAGES)
+    {
+        AT_LINK(link->prev)->next = link->next;
+    }
+    else
+    {
+        AT_free_head = link->next;
+    }
+    if (link->next != AT_MAX_PAGES)
+    {
+        AT_LINK(link->next)->prev = link->prev;
+    }
+}
+
+#endif  /* ENABLE_PMM_FREELIST */
+
+#define AT_WORD(page_index) ((page_index) / AT_WORD_BITS)
+#define AT_BIT(page_index)  (1u << ((page_index) % AT_WORD_BITS))
+
+static gcc_inline unsigned int at_get_perm(unsigned int page_index)
+{
+    return AT_desc[page_index] & AT_PERM_MASK;
+}
+
+/**
+ * Sets a word of the free bitmap. The pages whose free bit changes are put on
+ * or taken off the free list, and the change of the word between empty and
+ * non-empty is propagated to the summaries.
+ * The word is not written at all if it does not change.
+ */
+static gcc_inline void at_set_free_word(unsigned int word_index, unsigned int word)
+{
+    unsigned int sum_index = AT_WORD(word_index);
+    unsigned int was_empty = (AT_free[word_index] == 0);
+
+    if (AT_free[word_index] == word)
+    {
+        return;
+    }
+    AT_nfree += __builtin_popcount(word) - __builtin_popcount(AT_free[word_index]);
+#ifdef ENABLE_PMM_FREELIST
+    unsigned int changed = AT_free[word_index] ^ word;
+    unsigned int page_index;
+
+    while (changed != 0)
+    {
+        page_index = word_index * AT_WORD_BITS + __builtin_ctz(changed);
+        if (word & AT_BIT(page_index))
+        {
+            at_list_push(page_index);
+        }
+        else
+        {
+            at_list_remove(page_index);
+        }
+        changed &= changed - 1;
+    }
+#endif
+
+    AT_free[word_index] = word;
+    if (was_empty == (word == 0))
+    {
+        return;
+    }
+
+    // the word became empty or non-empty
+    was_empty = (AT_summary[sum_index] == 0);
+    if (word != 0)
+    {
+        AT_summary[sum_index] |= AT_BIT(word_index);
+    }
+    else
+    {
+        AT_summary[sum_index] &= ~AT_BIT(word_index);
+    }
+
+    if (was_empty != (AT_summary[sum_index] == 0))
+    {
+        AT_top[AT_WORD(sum_index)] ^= AT_BIT(sum_index);
+    }
+}
+
+/**
+ * Recomputes the free bit of the page from its permission, allocation flag and cache flag.
+ */
+static gcc_inline void at_update_free(unsigned int page_index)
+{
+    unsigned int word_index = AT_WORD(page_index);
+
+    if (at_get_perm(page_index) > 1 && (AT_desc[page_index] & (AT_ALLOCATED | AT_CACHED)) == 0)
+    {
+        at_set_free_word(word_index, AT_free[word_index] | AT_BIT(page_index));
+    }
+    else
+    {
+        at_set_free_word(word_index, AT_free[word_index] & ~AT_BIT(page_index));
+    }
+}
 
 // The getter function for NUM_PAGES.
 unsigned int get_nps(void)
@@ -42,6 +332,75 @@ void set_nps(unsigned int nps)
     NUM_PAGES = nps;
 }
 
+/**
+ * Returns the number of bytes taken by the tables of the AT
+ * covering the given number of pages.
+ * Each page takes one byte of descriptor, one of reference count and one of
+ * owner tag, plus about 1/8 byte of free bitmaps: about 3.1 bytes per page,
+ * or 1.6MB for a 2GB machine, against 4MB for the two ints per page of the
+ * old table. The descriptors and bitmaps alone are 580KB of it.
+ */
+unsigned int at_table_size(unsigned int npages)
+{
+    unsigned int nwords = AT_NWORDS(npages);
+    unsigned int nsummary = AT_NWORDS(nwords);
+    unsigned int ntop = AT_NWORDS(nsummary);
+
+    return (nwords + nsummary + ntop) * sizeof(unsigned int)
+        + 3 * npages;
+}
+
+/**
+ * Lays out the tables of the AT covering the pages [0, npages) in the memory
+ * starting from the given address, which must have at_table_size(npages) bytes,
+ * and marks all the pages as reserved and unallocated.
+ */
+void at_init(unsigned int table_addr, unsigned int npages)
+{
+    if (npages > AT_MAX_PAGES)
+    {
+        npages = AT_MAX_PAGES;
+    }
+
+    AT_npages = npages;
+    AT_nwords = AT_NWORDS(npages);
+    AT_nsummary = AT_NWORDS(AT_nwords);
+    AT_ntop = AT_NWORDS(AT_nsummary);
+
+    AT_free = (unsigned int *) table_addr;
+    AT_summary = AT_free + AT_nwords;
+    AT_top = AT_summary + AT_nsummary;
+    AT_ref = (unsigned char *) (AT_top + AT_ntop);
+    AT_desc = AT_ref + npages;
+    AT_owner = AT_desc + npages;
+    memzero((void *) table_addr, at_table_size(npages));
+    AT_nfree = 0;
+    AT_ncached = 0;
+    AT_nspill = 0;
+    memzero(AT_owner_live, sizeof(AT_owner_live));
+    memzero(AT_owner_peak, sizeof(AT_owner_peak));
+
+#ifdef ENABLE_PMM_FREELIST
+    AT_free_head = AT_MAX_PAGES;
+#endif
+}
+
+/**
+ * Returns the address of the tables laid out by at_init, or 0 before it.
+ */
+unsigned int at_table_addr(void)
+{
+    return (unsigned int) AT_free;
+}
+
+/**
+ * Returns the number of pages covered by the tables, [0, npages).
+ */
+unsigned int at_table_npages(void)
+{
+    return AT_npages;
+}
+
 /**
  * The getter function for the page permission.
  * If the page with the given index has the normal permission,
@@ -49,7 +408,7 @@ void set_nps(unsigned int nps)
  */
 unsigned int at_is_norm(unsigned int page_index)
 {
-    if (AT[page_index].perm > 1)
+    if (page_index < AT_npages && at_get_perm(page_index) > 1)
     {
         return 1;
     }
@@ -62,12 +421,86 @@ unsigned int at_is_norm(unsigned int page_index)
 /**
  * The setter function for the physical page permission.
  * Sets the permission of the page with given index.
- * It also marks the page as unallocated.
+ * All normal permissions (> 1) are stored as 2.
+ * It also marks the page as unallocated and not cached.
  */
 void at_set_perm(unsigned int page_index, unsigned int perm)
 {
-    AT[page_index].perm = perm;
-    AT[page_index].allocated = 0;
+    if (page_index >= AT_npages)
+    {
+        return;
+    }
+    if (perm > 2)
+    {
+        perm = 2;
+    }
+    if (AT_desc[page_index] & AT_ALLOCATED)
+    {
+        AT_owner_live[AT_owner[page_index]]--;
+    }
+    if (AT_desc[page_index] & AT_CACHED)
+    {
+        AT_ncached--;
+    }
+    AT_desc[page_index] = (AT_desc[page_index] & ~(AT_PERM_MASK | AT_ALLOCATED | AT_CACHED)) | perm;
+    at_ref_store(page_index, 0);
+    at_update_free(page_index);
+}
+
+/**
+ * The setter function for the permission of the pages [lo, hi).
+ * It has the same effect as at_set_perm on each of the pages,
+ * but the free bitmap is only updated once per word.
+ * An empty range, with lo >= hi, is left alone.
+ */
+void at_set_perm_range(unsigned int lo, unsigned int hi, unsigned int perm)
+{
+    unsigned int page_index = lo;
+    unsigned int word_index;
+    unsigned int word;
+
+    if (hi > AT_npages)
+    {
+        hi = AT_npages;
+    }
+    if (lo >= hi)
+    {
+        return;
+    }
+    if (perm > 2)
+    {
+        perm = 2;
+    }
+
+    while (page_index < hi)
+    {
+        word_index = AT_WORD(page_index);
+        word = AT_free[word_index];
+        do
+        {
+            if (AT_desc[page_index] & AT_ALLOCATED)
+            {
+                AT_owner_live[AT_owner[page_index]]--;
+            }
+            if (AT_desc[page_index] & AT_CACHED)
+            {
+                AT_ncached--;
+            }
+            AT_desc[page_index] =
+                (AT_desc[page_index] & ~(AT_PERM_MASK | AT_ALLOCATED | AT_CACHED)) | perm;
+            at_ref_store(page_index, 0);
+            if (perm > 1)
+            {
+                word |= AT_BIT(page_index);
+            }
+            else
+            {
+                word &= ~AT_BIT(page_index);
+            }
+            page_index++;
+        } while (page_index < hi && page_index % AT_WORD_BITS != 0);
+        at_set_free_word(word_index, word);
+    }
 }
 
 /**
@@ -76,7 +509,7 @@ void at_set_perm(unsigned int page_index, unsigned int perm)
  */
 unsigned int at_is_allocated(unsigned int page_index)
 {
-    if (AT[page_index].allocated == 0)
+    if (page_index >= AT_npages || (AT_desc[page_index] & AT_ALLOCATED) == 0)
     {
         return 0;
     }
@@ -89,8 +522,441 @@ unsigned int at_is_allocated(unsigned int page_index)
 /**
  * The setter function for the physical page allocation flag.
  * Set the flag of the page with given index to the given value.
+ * The reference count of the page is set to 1 or 0 accordingly.
  */
 void at_set_allocated(unsigned int page_index, unsigned int allocated)
 {
-    AT[page_index].allocated = allocated;
+    if (page_index >= AT_npages)
+    {
+        return;
+    }
+    if (allocated == 0)
+    {
+        if (AT_desc[page_index] & AT_ALLOCATED)
+        {
+            AT_owner_live[AT_owner[page_index]]--;
+        }
+        AT_desc[page_index] &= ~AT_ALLOCATED;
+        at_ref_store(page_index, 0);
+    }
+    else
+    {
+        if ((AT_desc[page_index] & AT_ALLOCATED) == 0)
+        {
+            AT_owner[page_index] = 0;
+            AT_desc[page_index] &= ~AT_MERGED;
+            at_owner_add(0, 1);
+        }
+        AT_desc[page_index] |= AT_ALLOCATED;
+        at_ref_store(page_index, 1);
+    }
+    at_update_free(page_index);
+}
+
+/**
+ * The setter function for the allocation flag of the pages [lo, hi).
+ * It has the same effect as at_set_allocated on each of the pages,
+ * but the free bitmap is only updated once per word.
+ * An empty range, with lo >= hi, is left alone.
+ */
+void at_set_allocated_range(unsigned int lo, unsigned int hi, unsigned int allocated)
+{
+    unsigned int page_index = lo;
+    unsigned int word_index;
+    unsigned int word;
+    unsigned int nnew = 0;
+
+    if (hi > AT_npages)
+    {
+        hi = AT_npages;
+    }
+    if (lo >= hi)
+    {
+        return;
+    }
+
+    while (page_index < hi)
+    {
+        word_index = AT_WORD(page_index);
+        word = AT_free[word_index];
+        do
+        {
+            if (allocated == 0)
+            {
+                if (AT_desc[page_index] & AT_ALLOCATED)
+                {
+                    AT_owner_live[AT_owner[page_index]]--;
+                }
+                AT_desc[page_index] &= ~AT_ALLOCATED;
+                at_ref_store(page_index, 0);
+                if (at_get_perm(page_index) > 1 && (AT_desc[page_index] & AT_CACHED) == 0)
+                {
+                    word |= AT_BIT(page_index);
+                }
+            }
+            else
+            {
+                if ((AT_desc[page_index] & AT_ALLOCATED) == 0)
+                {
+                    AT_owner[page_index] = 0;
+                    AT_desc[page_index] &= ~AT_MERGED;
+                    nnew++;
+                }
+                AT_desc[page_index] |= AT_ALLOCATED;
+                at_ref_store(page_index, 1);
+                word &= ~AT_BIT(page_index);
+            }
+            page_index++;
+        } while (page_index < hi && page_index % AT_WORD_BITS != 0);
+        at_set_free_word(word_index, word);
+    }
+    if (nnew != 0)
+    {
+        at_owner_add(0, nnew);
+    }
+}
+
+/**
+ * The getter function for the page reference count.
+ * It is 0 iff the page is not allocated.
+ */
+unsigned int at_get_ref(unsigned int page_index)
+{
+    struct at_spill *spill;
+
+    if (page_index >= AT_npages)
+    {
+        return 0;
+    }
+    if (AT_ref[page_index] != AT_REF_SPILL)
+    {
+        return AT_ref[page_index];
+    }
+    spill = at_spill_find(page_index);
+    return spill != NULL ? spill->ref : AT_MAX_REF;
+}
+
+/**
+ * The setter function for the page reference count, which is capped at 65535.
+ * The page is allocated iff the count is not 0.
+ */
+void at_set_ref(unsigned int page_index, unsigned int ref)
+{
+    if (page_index >= AT_npages)
+    {
+        return;
+    }
+    if (ref > AT_MAX_REF)
+    {
+        ref = AT_MAX_REF;
+    }
+    at_ref_store(page_index, ref);
+    if (ref == 0)
+    {
+        if (AT_desc[page_index] & AT_ALLOCATED)
+        {
+            AT_owner_live[AT_owner[page_index]]--;
+        }
+        AT_desc[page_index] &= ~AT_ALLOCATED;
+    }
+    else
+    {
+        if ((AT_desc[page_index] & AT_ALLOCATED) == 0)
+        {
+            AT_owner[page_index] = 0;
+            AT_desc[page_index] &= ~AT_MERGED;
+            at_owner_add(0, 1);
+        }
+        AT_desc[page_index] |= AT_ALLOCATED;
+    }
+    at_update_free(page_index);
+}
+
+/**
+ * The getter function for the owner tag of an allocated page.
+ * Returns 0 if the page is not allocated.
+ */
+unsigned int at_get_owner(unsigned int page_index)
+{
+    if (page_index >= AT_npages || (AT_desc[page_index] & AT_ALLOCATED) == 0)
+    {
+        return 0;
+    }
+    return AT_owner[page_index];
+}
+
+/**
+ * The setter function for the owner tag of the allocated pages in [lo, hi),
+ * which are then counted for the new owner instead of the old one.
+ * Tags not below 256 and unallocated pages are ignored.
+ */
+void at_set_owner_range(unsigned int lo, unsigned int hi, unsigned int owner)
+{
+    unsigned int page_index;
+    unsigned int n = 0;
+
+    if (owner >= AT_NUM_OWNERS)
+    {
+        return;
+    }
+    if (hi > AT_npages)
+    {
+        hi = AT_npages;
+    }
+    for (page_index = lo; page_index < hi; page_index++)
+    {
+        if (AT_desc[page_index] & AT_ALLOCATED)
+        {
+            AT_owner_live[AT_owner[page_index]]--;
+            AT_owner[page_index] = owner;
+            n++;
+        }
+    }
+    if (n != 0)
+    {
+        at_owner_add(owner, n);
+    }
+}
+
+/**
+ * Returns the number of allocated pages of the owner, and through peak,
+ * the highest number it has had.
+ */
+unsigned int at_owner_pages(unsigned int owner, unsigned int *peak)
+{
+    if (owner >= AT_NUM_OWNERS)
+    {
+        *peak = 0;
+        return 0;
+    }
+    *peak = AT_owner_peak[owner];
+    return AT_owner_live[owner];
 }
+
+/**
+ * The getter function for the merged flag.
+ * Returns 1 if the page is allocated and its frame is shared by merged pages.
+ */
+unsigned int at_is_merged(unsigned int page_index)
+{
+    if (page_index >= AT_npages || (AT_desc[page_index] & AT_ALLOCATED) == 0)
+    {
+        return 0;
+    }
+    return (AT_desc[page_index] & AT_MERGED) != 0;
+}
+
+/**
+ * The setter function for the merged flag of an allocated page.
+ * Unallocated pages are left alone.
+ */
+void at_set_merged(unsigned int page_index, unsigned int merged)
+{
+    if (page_index >= AT_npages || (AT_desc[page_index] & AT_ALLOCATED) == 0)
+    {
+        return;
+    }
+    if (merged == 0)
+    {
+        AT_desc[page_index] &= ~AT_MERGED;
+    }
+    else
+    {
+        AT_desc[page_index] |= AT_MERGED;
+    }
+}
+
+/**
+ * The getter function for the page cache flag.
+ * Returns 1 if the page is held in a page cache, otherwise returns 0.
+ */
+unsigned int at_is_cached(unsigned int page_index)
+{
+    if (page_index >= AT_npages)
+    {
+        return 0;
+    }
+    return (AT_desc[page_index] & AT_CACHED) != 0;
+}
+
+/**
+ * The setter function for the page cache flag.
+ * A cached page is not allocated, but it is kept out of the free bitmap
+ * (and the free list), so that only the CPU caching it can hand it out.
+ */
+void at_set_cached(unsigned int page_index, unsigned int cached)
+{
+    if (page_index >= AT_npages)
+    {
+        return;
+    }
+    if ((cached != 0) != ((AT_desc[page_index] & AT_CACHED) != 0))
+    {
+        AT_ncached += cached != 0 ? 1 : -1;
+    }
+    if (cached == 0)
+    {
+        AT_desc[page_index] &= ~AT_CACHED;
+    }
+    else
+    {
+        AT_desc[page_index] |= AT_CACHED;
+    }
+    at_update_free(page_index);
+}
+
+/**
+ * The setter function for the cache flag of the pages [lo, hi).
+ * It has the same effect as at_set_cached on each of the pages,
+ * but the free bitmap is only updated once per word.
+ * An empty range, with lo >= hi, is left alone.
+ */
+void at_set_cached_range(unsigned int lo, unsigned int hi, unsigned int cached)
+{
+    unsigned int page_index = lo;
+    unsigned int word_index;
+    unsigned int word;
+
+    if (hi > AT_npages)
+    {
+        hi = AT_npages;
+    }
+    if (lo >= hi)
+    {
+        return;
+    }
+
+    while (page_index < hi)
+    {
+        word_index = AT_WORD(page_index);
+        word = AT_free[word_index];
+        do
+        {
+            if ((cached != 0) != ((AT_desc[page_index] & AT_CACHED) != 0))
+            {
+                AT_ncached += cached != 0 ? 1 : -1;
+            }
+            if (cached == 0)
+            {
+                AT_desc[page_index] &= ~AT_CACHED;
+                if (at_get_perm(page_index) > 1 && (AT_desc[page_index] & AT_ALLOCATED) == 0)
+                {
+                    word |= AT_BIT(page_index);
+                }
+            }
+            else
+            {
+                AT_desc[page_index] |= AT_CACHED;
+                word &= ~AT_BIT(page_index);
+            }
+            page_index++;
+        } while (page_index < hi && page_index % AT_WORD_BITS != 0);
+        at_set_free_word(word_index, word);
+    }
+}
+
+/**
+ * Returns the number of pages that are normal, unallocated and not cached.
+ */
+unsigned int at_nfree_pages(void)
+{
+    return AT_nfree;
+}
+
+/**
+ * Returns the number of pages held in the page caches.
+ */
+unsigned int at_ncached_pages(void)
+{
+    return AT_ncached;
+}
+
+/**
+ * The getter function for one word of the free bitmap.
+ * Bit i of the returned value is set iff the page with index
+ * (word_index * 32 + i) is normal, unallocated and not cached.
+ */
+unsigned int at_free_word(unsigned int word_index)
+{
+    if (word_index >= AT_nwords)
+    {
+        return 0;
+    }
+    return AT_free[word_index];
+}
+
+/**
+ * Returns the index of the first normal and unallocated page whose index is
+ * not less than the given one, or 2^20 if there is no such page.
+ * It looks at no more than one word at each level of the summaries,
+ * plus the top level, no matter how much of the table is allocated.
+ */
+unsigned int at_next_free(unsigned int page_index)
+{
+    unsigned int word_index;
+    unsigned int sum_index;
+    unsigned int top_index;
+    unsigned int word;
+
+    if (page_index >= AT_npages)
+    {
+        return AT_MAX_PAGES;
+    }
+
+    // the rest of the word containing the page
+    word_index = AT_WORD(page_index);
+    word = AT_free[word_index] & (~0u << (page_index % AT_WORD_BITS));
+    if (word != 0)
+    {
+        return word_index * AT_WORD_BITS + __builtin_ctz(word);
+    }
+
+    // the rest of the summary word containing the next word
+    word_index++;
+    if (word_index == AT_nwords)
+    {
+        return AT_MAX_PAGES;
+    }
+    sum_index = AT_WORD(word_index);
+    word = AT_summary[sum_index] & (~0u << (word_index % AT_WORD_BITS));
+
+    if (word == 0)
+    {
+        // the top level, starting from the next summary word
+        sum_index++;
+        if (sum_index == AT_nsummary)
+        {
+            return AT_MAX_PAGES;
+        }
+        top_index = AT_WORD(sum_index);
+        word = AT_top[top_index] & (~0u << (sum_index % AT_WORD_BITS));
+        while (word == 0)
+        {
+            top_index++;
+            if (top_index == AT_ntop)
+            {
+                return AT_MAX_PAGES;
+            }
+            word = AT_top[top_index];
+        }
+        sum_index = top_index * AT_WORD_BITS + __builtin_ctz(word);
+        word = AT_summary[sum_index];
+    }
+
+    word_index = sum_index * AT_WORD_BITS + __builtin_ctz(word);
+    return word_index * AT_WORD_BITS + __builtin_ctz(AT_free[word_index]);
+}
+
+#ifdef ENABLE_PMM_FREELIST
+
+/**
+ * The getter function for the head of the free list.
+ * Returns the index of the most recently freed normal and unallocated page,
+ * or 2^20 if there is no such page.
+ */
+unsigned int at_free_head(void)
+{
+    return AT_free_head;
+}
+
+#endif  /* ENABLE_PMM_FREELIST */
@@ -0,0 +1,200 @@
+#include <lib/debug.h>
+#include <lib/gcc.h>
+#include <lib/types.h>
+#include <lib/x86.h>
+#include "export.h"
+
+/**
+ * Benchmarks of the allocation table, run at boot when the kernel is built
+ * with BENCH=1. They only read the table.
+ */
+
+// Number of passes over the table in each benchmark.
+#define BENCH_ROUNDS 4
+
+#define PAGESIZE 4096
+#define VM_USERLO 0x40000000
+#define VM_USERLO_PI (VM_USERLO / PAGESIZE)
+
+/**
+ * The descriptor of a page in the layout the table had before the
+ * descriptors were packed into one byte: two ints per page.
+ */
+struct bench_old_desc
+{
+    unsigned int perm;
+    unsigned int allocated;
+};
+
+// Number of pages holding the table in the old layout, 8MB.
+#define BENCH_OLD_NPAGES ((1 << 20) * sizeof(struct bench_old_desc) / PAGESIZE)
+
+static struct bench_old_desc *bench_old;
+static unsigned int bench_old_nps;
+
+/**
+ * The getters of the old layout, out of line and checking the page index
+ * as the getters of MATIntro do, so that both scans pay for the same calls
+ * and only differ by the layout of the table they read.
+ */
+static gcc_noinline unsigned int bench_old_is_norm(unsigned int page_index)
+{
+    if (page_index >= bench_old_nps)
+    {
+        return 0;
+    }
+    return bench_old[page_index].perm > 1;
+}
+
+static gcc_noinline unsigned int bench_old_is_allocated(unsigned int page_index)
+{
+    if (page_index >= bench_old_nps)
+    {
+        return 0;
+    }
+    return bench_old[page_index].allocated;
+}
+
+static void bench_report(const char *name, uint64_t cycles, unsigned int npages)
+{
+    if (npages < 1000)
+    {
+        dprintf("  %s: %u pages in %llu cycles\n", name, npages, (unsigned long long) cycles);
+        return;
+    }
+    dprintf("  %s: %u pages, %llu cycles per 1000 pages\n",
+            name, npages, (unsigned long long) (cycles / (npages / 1000)));
+}
+
+/**
+ * Returns the first page of a run of n free pages of the user range,
+ * or 0 if there is none.
+ */
+static unsigned int bench_free_run(unsigned int n)
+{
+    unsigned int base = at_next_free(VM_USERLO_PI);
+    unsigned int i = 0;
+
+    while (i < n && base + n <= get_nps())
+    {
+        if (at_next_free(base + i) != base + i)
+        {
+            base = at_next_free(base + i);
+            i = 0;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return i == n ? base : 0;
+}
+
+/**
+ * Copies the table into the old layout, in free pages of the user range
+ * taken for the time of the benchmark, and reads the descriptor of every
+ * page from it through its getters, as the descriptor scan does from the
+ * packed table.
+ */
+static void bench_old_scan(void)
+{
+    unsigned int nps = get_nps();
+    unsigned int base = bench_free_run(BENCH_OLD_NPAGES);
+    unsigned int round;
+    unsigned int page_index;
+    unsigned int nfree = 0;
+    uint64_t start;
+
+    if (base == 0)
+    {
+        dprintf("  old layout scan: no room for the old table\n");
+        return;
+    }
+
+    bench_old = (struct bench_old_desc *) (base * PAGESIZE);
+    bench_old_nps = nps;
+    for (page_index = 0; page_index < nps; page_index++)
+    {
+        bench_old[page_index].perm = at_is_norm(page_index) ? 2 : 1;
+        bench_old[page_index].allocated = at_is_allocated(page_index);
+    }
+    at_set_allocated_range(base, base + BENCH_OLD_NPAGES, 1);
+
+    start = rdtsc();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (page_index = 0; page_index < nps; page_index++)
+        {
+            if (bench_old_is_norm(page_index) && !bench_old_is_allocated(page_index))
+            {
+                nfree++;
+            }
+        }
+    }
+    bench_report("old layout scan", rdtsc() - start, nps * BENCH_ROUNDS);
+    dprintf("    %u free pages\n", nfree / BENCH_ROUNDS);
+
+    at_set_allocated_range(base, base + BENCH_OLD_NPAGES, 0);
+}
+
+/**
+ * Reads the descriptor of every page through the getters,
+ * as the original linear palloc did.
+ */
+static void bench_desc_scan(void)
+{
+    unsigned int nps = get_nps();
+    unsigned int round;
+    unsigned int page_index;
+    unsigned int nfree = 0;
+    uint64_t start;
+
+    start = rdtsc();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (page_index = 0; page_index < nps; page_index++)
+        {
+            if (at_is_norm(page_index) && !at_is_allocated(page_index))
+            {
+                nfree++;
+            }
+        }
+    }
+    bench_report("descriptor scan", rdtsc() - start, nps * BENCH_ROUNDS);
+    dprintf("    %u free pages\n", nfree / BENCH_ROUNDS);
+}
+
+/**
+ * Visits every free page through the free bitmap and its summaries.
+ */
+static void bench_free_scan(void)
+{
+    unsigned int round;
+    unsigned int page_index;
+    unsigned int nfree = 0;
+    uint64_t start;
+
+    start = rdtsc();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (page_index = at_next_free(0); page_index < (1 << 20);
+             page_index = at_next_free(page_index + 1))
+        {
+            nfree++;
+        }
+    }
+    bench_report("free bitmap scan", rdtsc() - start, nfree);
+}
+
+void bench_MATIntro(void)
+{
+    extern uint8_t edata[], end[];
+
+    dprintf("  kernel bss: %u KB, without the allocation table\n", (unsigned int) (end - edata) / 1024);
+    dprintf("  allocation table: %u KB, %u KB in the old layout\n",
+            at_table_size(get_nps()) / 1024,
+            get_nps() * (unsigned int) sizeof(struct bench_old_desc) / 1024);
+    bench_old_scan();
+    bench_desc_scan();
+    bench_free_scan();
+}
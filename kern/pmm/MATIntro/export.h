@@ -6,11 +6,42 @@
 unsigned int get_nps(void);
 void set_nps(unsigned int page_index);
 
+unsigned int at_table_size(unsigned int npages);
+void at_init(unsigned int table_addr, unsigned int npages);
+unsigned int at_table_addr(void);
+unsigned int at_table_npages(void);
+
 unsigned int at_is_norm(unsigned int page_index);
 void at_set_perm(unsigned int page_index, unsigned int perm);
+void at_set_perm_range(unsigned int lo, unsigned int hi, unsigned int perm);
 
 unsigned int at_is_allocated(unsigned int page_index);
 void at_set_allocated(unsigned int page_index, unsigned int allocated);
+void at_set_allocated_range(unsigned int lo, unsigned int hi, unsigned int allocated);
+
+unsigned int at_get_ref(unsigned int page_index);
+void at_set_ref(unsigned int page_index, unsigned int ref);
+
+unsigned int at_is_merged(unsigned int page_index);
+void at_set_merged(unsigned int page_index, unsigned int merged);
+
+unsigned int at_get_owner(unsigned int page_index);
+void at_set_owner_range(unsigned int lo, unsigned int hi, unsigned int owner);
+unsigned int at_owner_pages(unsigned int owner, unsigned int *peak);
+
+unsigned int at_is_cached(unsigned int page_index);
+void at_set_cached(unsigned int page_index, unsigned int cached);
+void at_set_cached_range(unsigned int lo, unsigned int hi, unsigned int cached);
+
+unsigned int at_nfree_pages(void);
+unsigned int at_ncached_pages(void);
+
+unsigned int at_free_word(unsigned int word_index);
+unsigned int at_next_free(unsigned int page_index);
+
+#ifdef ENABLE_PMM_FREELIST
+unsigned int at_free_head(void);
+#endif
 
 #endif  /* _KERN_ */
 
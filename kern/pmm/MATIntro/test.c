@@ -1,6 +1,39 @@
 #include <lib/debug.h>
 #include "export.h"
 
+#define PAGESIZE 4096
+#define VM_USERLO 0x40000000
+#define VM_USERLO_PI (VM_USERLO / PAGESIZE)
+
+/**
+ * Some tests change the permissions of pages, and with ENABLE_PMM_FREELIST
+ * a page that becomes free gets the links of the free list written into it.
+ * So they work on a run of free pages of the user range, which they mark as
+ * allocated first, instead of on pages of the kernel.
+ */
+#define TEST_NPAGES 64
+
+static unsigned int test_take(void)
+{
+    unsigned int base = (at_next_free(VM_USERLO_PI) + TEST_NPAGES - 1) / TEST_NPAGES * TEST_NPAGES;
+    unsigned int i = 0;
+    while (i < TEST_NPAGES && base < get_nps()) {
+        if (at_next_free(base + i) != base + i) {
+            base += TEST_NPAGES;
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    at_set_allocated_range(base, base + TEST_NPAGES, 1);
+    return base;
+}
+
+static void test_give_back(unsigned int base)
+{
+    at_set_perm_range(base, base + TEST_NPAGES, 2);
+}
+
 int MATIntro_test1()
 {
     int rn10[] = { 1, 3, 5, 6, 78, 3576, 32, 8, 0, 100 };
@@ -21,31 +54,32 @@ int MATIntro_test1()
 
 int MATIntro_test2()
 {
-    at_set_perm(0, 0);
-    if (at_is_norm(0) != 0 || at_is_allocated(0) != 0) {
-        dprintf("test 2.1 failed: (%d != 0 || %d != 0)\n", at_is_norm(0), at_is_allocated(0));
-        at_set_perm(0, 0);
+    unsigned int page_index = test_take();
+    at_set_perm(page_index, 0);
+    if (at_is_norm(page_index) != 0 || at_is_allocated(page_index) != 0) {
+        dprintf("test 2.1 failed: (%d != 0 || %d != 0)\n", at_is_norm(page_index), at_is_allocated(page_index));
+        test_give_back(page_index);
         return 1;
     }
-    at_set_perm(0, 1);
-    if (at_is_norm(0) != 0 || at_is_allocated(0) != 0) {
-        dprintf("test 2.2 failed: (%d != 0 || %d != 0)\n", at_is_norm(0), at_is_allocated(0));
-        at_set_perm(0, 0);
+    at_set_perm(page_index, 1);
+    if (at_is_norm(page_index) != 0 || at_is_allocated(page_index) != 0) {
+        dprintf("test 2.2 failed: (%d != 0 || %d != 0)\n", at_is_norm(page_index), at_is_allocated(page_index));
+        test_give_back(page_index);
         return 1;
     }
-    at_set_perm(0, 2);
-    if (at_is_norm(0) != 1 || at_is_allocated(0) != 0) {
-        dprintf("test 2.3 failed: (%d != 1 || %d != 0)\n", at_is_norm(0), at_is_allocated(0));
-        at_set_perm(0, 0);
+    at_set_perm(page_index, 2);
+    if (at_is_norm(page_index) != 1 || at_is_allocated(page_index) != 0) {
+        dprintf("test 2.3 failed: (%d != 1 || %d != 0)\n", at_is_norm(page_index), at_is_allocated(page_index));
+        test_give_back(page_index);
         return 1;
     }
-    at_set_perm(0, 100);
-    if (at_is_norm(0) != 1 || at_is_allocated(0) != 0) {
-        dprintf("test 2.4 failed: (%d != 1 || %d != 0)\n", at_is_norm(0), at_is_allocated(0));
-        at_set_perm(0, 0);
+    at_set_perm(page_index, 100);
+    if (at_is_norm(page_index) != 1 || at_is_allocated(page_index) != 0) {
+        dprintf("test 2.4 failed: (%d != 1 || %d != 0)\n", at_is_norm(page_index), at_is_allocated(page_index));
+        test_give_back(page_index);
         return 1;
     }
-    at_set_perm(0, 0);
+    test_give_back(page_index);
     dprintf("test 2 passed.\n");
     return 0;
 }
@@ -75,6 +109,242 @@ int MATIntro_test3()
     return 0;
 }
 
+int MATIntro_test4()
+{
+    unsigned int base = test_take();
+    unsigned int word_index = base / 32;
+    at_set_perm(base, 2);
+    if ((at_free_word(word_index) & 0x1) != 0x1) {
+        dprintf("test 4.1 failed: (%d != 1)\n", at_free_word(word_index) & 0x1);
+        test_give_back(base);
+        return 1;
+    }
+    at_set_allocated(base, 1);
+    if ((at_free_word(word_index) & 0x1) != 0) {
+        dprintf("test 4.2 failed: (%d != 0)\n", at_free_word(word_index) & 0x1);
+        test_give_back(base);
+        return 1;
+    }
+    at_set_allocated(base, 0);
+    if ((at_free_word(word_index) & 0x1) != 0x1) {
+        dprintf("test 4.3 failed: (%d != 1)\n", at_free_word(word_index) & 0x1);
+        test_give_back(base);
+        return 1;
+    }
+    at_set_perm(base, 0);
+    if ((at_free_word(word_index) & 0x1) != 0) {
+        dprintf("test 4.4 failed: (%d != 0)\n", at_free_word(word_index) & 0x1);
+        test_give_back(base);
+        return 1;
+    }
+    test_give_back(base);
+    dprintf("test 4 passed.\n");
+    return 0;
+}
+
+int MATIntro_test5()
+{
+    unsigned int base = test_take();
+    at_set_perm(base + 8, 2);
+    if (at_next_free(base) != base + 8) {
+        dprintf("test 5.1 failed: (%d != %d)\n", at_next_free(base), base + 8);
+        test_give_back(base);
+        return 1;
+    }
+    at_set_allocated(base + 8, 1);
+    if (at_next_free(base) <= base + 8) {
+        dprintf("test 5.2 failed: (%d <= %d)\n", at_next_free(base), base + 8);
+        test_give_back(base);
+        return 1;
+    }
+    test_give_back(base);
+    if (at_next_free(1 << 20) != (1 << 20)) {
+        dprintf("test 5.3 failed: (%d != %d)\n", at_next_free(1 << 20), 1 << 20);
+        return 1;
+    }
+    dprintf("test 5 passed.\n");
+    return 0;
+}
+
+int MATIntro_test6()
+{
+    unsigned int base = test_take();
+    at_set_perm_range(base, base + TEST_NPAGES, 1);
+    at_set_perm_range(base + 6, base + 36, 2);
+    if (at_is_norm(base + 5) != 0 || at_is_norm(base + 6) != 1 || at_is_norm(base + 35) != 1 || at_is_norm(base + 36) != 0) {
+        dprintf("test 6.1 failed: (%d != 0 || %d != 1 || %d != 1 || %d != 0)\n",
+                at_is_norm(base + 5), at_is_norm(base + 6), at_is_norm(base + 35), at_is_norm(base + 36));
+        test_give_back(base);
+        return 1;
+    }
+    if (at_next_free(base) != base + 6) {
+        dprintf("test 6.2 failed: (%d != %d)\n", at_next_free(base), base + 6);
+        test_give_back(base);
+        return 1;
+    }
+    at_set_allocated_range(base + 6, base + 32, 1);
+    if (at_is_allocated(base + 31) != 1 || at_next_free(base) != base + 32) {
+        dprintf("test 6.3 failed: (%d != 1 || %d != %d)\n", at_is_allocated(base + 31), at_next_free(base), base + 32);
+        test_give_back(base);
+        return 1;
+    }
+    at_set_perm_range(base + 6, base + 36, 1);
+    if (at_is_allocated(base + 16) != 0 || at_next_free(base) < base + 36) {
+        dprintf("test 6.4 failed: (%d != 0 || %d < %d)\n", at_is_allocated(base + 16), at_next_free(base), base + 36);
+        test_give_back(base);
+        return 1;
+    }
+    test_give_back(base);
+    dprintf("test 6 passed.\n");
+    return 0;
+}
+
+int MATIntro_test7()
+{
+    unsigned int base, i;
+    at_set_allocated(1, 1);
+    if (at_get_ref(1) != 1) {
+        dprintf("test 7.1 failed: (%d != 1)\n", at_get_ref(1));
+        at_set_allocated(1, 0);
+        return 1;
+    }
+    at_set_ref(1, 3);
+    if (at_get_ref(1) != 3 || at_is_allocated(1) != 1) {
+        dprintf("test 7.2 failed: (%d != 3 || %d != 1)\n", at_get_ref(1), at_is_allocated(1));
+        at_set_allocated(1, 0);
+        return 1;
+    }
+    at_set_ref(1, 0);
+    if (at_get_ref(1) != 0 || at_is_allocated(1) != 0) {
+        dprintf("test 7.3 failed: (%d != 0 || %d != 0)\n", at_get_ref(1), at_is_allocated(1));
+        return 1;
+    }
+    at_set_ref(1, 1 << 20);
+    if (at_get_ref(1) != 0xffff) {
+        dprintf("test 7.4 failed: (%d != 65535)\n", at_get_ref(1));
+        at_set_allocated(1, 0);
+        return 1;
+    }
+    at_set_allocated(1, 0);
+
+    base = test_take();
+    at_set_ref(base, 300);
+    at_set_ref(base + 1, 2);
+    if (at_get_ref(base) != 300 || at_get_ref(base + 1) != 2) {
+        dprintf("test 7.5 failed: (%d != 300 || %d != 2)\n", at_get_ref(base), at_get_ref(base + 1));
+        test_give_back(base);
+        return 1;
+    }
+    at_set_ref(base, 2);
+    if (at_get_ref(base) != 2 || at_is_allocated(base) != 1) {
+        dprintf("test 7.6 failed: (%d != 2 || %d != 1)\n", at_get_ref(base), at_is_allocated(base));
+        test_give_back(base);
+        return 1;
+    }
+    // Large counts past what the spill table holds saturate.
+    for (i = 0; i < TEST_NPAGES; i++) {
+        at_set_ref(base + i, 1000 + i);
+        if (at_get_ref(base + i) != 1000 + i) {
+            break;
+        }
+    }
+    if (i == TEST_NPAGES || at_get_ref(base + i) != 0xffff) {
+        dprintf("test 7.7 failed: (%d == %d || %d != 65535)\n", i, TEST_NPAGES, at_get_ref(base + i));
+        test_give_back(base);
+        return 1;
+    }
+    at_set_ref(base, 1);
+    at_set_ref(base + i, 2000);
+    if (at_get_ref(base) != 1 || at_get_ref(base + i) != 2000 || (i > 1 && at_get_ref(base + 1) != 1001)) {
+        dprintf("test 7.8 failed: (%d != 1 || %d != 2000 || %d != 1001)\n", at_get_ref(base), at_get_ref(base + i), at_get_ref(base + 1));
+        test_give_back(base);
+        return 1;
+    }
+    test_give_back(base);
+    dprintf("test 7 passed.\n");
+    return 0;
+}
+
+int MATIntro_test8()
+{
+    unsigned int live, peak, peak0;
+    live = at_owner_pages(200, &peak0);
+    at_set_allocated(1, 1);
+    at_set_owner_range(1, 2, 200);
+    if (at_get_owner(1) != 200 || at_owner_pages(200, &peak) != live + 1) {
+        dprintf("test 8.1 failed: (%d != 200 || %d != %d)\n", at_get_owner(1), at_owner_pages(200, &peak), live + 1);
+        at_set_allocated(1, 0);
+        return 1;
+    }
+    at_set_allocated(1, 0);
+    if (at_get_owner(1) != 0 || at_owner_pages(200, &peak) != live) {
+        dprintf("test 8.2 failed: (%d != 0 || %d != %d)\n", at_get_owner(1), at_owner_pages(200, &peak), live);
+        return 1;
+    }
+    if (peak < live + 1 || peak < peak0) {
+        dprintf("test 8.3 failed: (peak %d < %d)\n", peak, live + 1);
+        return 1;
+    }
+    dprintf("test 8 passed.\n");
+    return 0;
+}
+
+int MATIntro_test9()
+{
+    unsigned int nfree = 0;
+    unsigned int ncached = at_ncached_pages();
+    unsigned int word_index;
+    unsigned int page_index;
+    for (word_index = 0; word_index < (get_nps() + 31) / 32; word_index++) {
+        nfree += __builtin_popcount(at_free_word(word_index));
+    }
+    if (at_nfree_pages() != nfree) {
+        dprintf("test 9.1 failed: (%d != %d)\n", at_nfree_pages(), nfree);
+        return 1;
+    }
+    page_index = at_next_free(0);
+    at_set_cached(page_index, 1);
+    if (at_nfree_pages() != nfree - 1 || at_ncached_pages() != ncached + 1) {
+        dprintf("test 9.2 failed: (%d != %d || %d != %d)\n", at_nfree_pages(), nfree - 1, at_ncached_pages(), ncached + 1);
+        at_set_cached(page_index, 0);
+        return 1;
+    }
+    at_set_cached(page_index, 0);
+    if (at_nfree_pages() != nfree || at_ncached_pages() != ncached) {
+        dprintf("test 9.3 failed: (%d != %d || %d != %d)\n", at_nfree_pages(), nfree, at_ncached_pages(), ncached);
+        return 1;
+    }
+    dprintf("test 9 passed.\n");
+    return 0;
+}
+
+int MATIntro_test10()
+{
+    unsigned int page_index = at_next_free(0);
+    at_set_merged(page_index, 1);
+    if (at_is_merged(page_index) != 0) {
+        dprintf("test 10.1 failed: unallocated page %d is merged\n", page_index);
+        return 1;
+    }
+    at_set_allocated(page_index, 1);
+    at_set_merged(page_index, 1);
+    if (at_is_merged(page_index) != 1) {
+        dprintf("test 10.2 failed: page %d is not merged\n", page_index);
+        at_set_allocated(page_index, 0);
+        return 1;
+    }
+    at_set_allocated(page_index, 0);
+    at_set_allocated(page_index, 1);
+    if (at_is_merged(page_index) != 0) {
+        dprintf("test 10.3 failed: reallocated page %d is still merged\n", page_index);
+        at_set_allocated(page_index, 0);
+        return 1;
+    }
+    at_set_allocated(page_index, 0);
+    dprintf("test 10 passed.\n");
+    return 0;
+}
+
 /**
  * Write Your Own Test Script (optional)
  *
@@ -97,5 +367,6 @@ int MATIntro_test_own()
 
 int test_MATIntro()
 {
-    return MATIntro_test1() + MATIntro_test2() + MATIntro_test3() + MATIntro_test_own();
+    return MATIntro_test1() + MATIntro_test2() + MATIntro_test3() + MATIntro_test4()
+        + MATIntro_test5() + MATIntro_test6() + MATIntro_test7() + MATIntro_test8() + MATIntro_test9() + MATIntro_test10() + MATIntro_test_own();
 }
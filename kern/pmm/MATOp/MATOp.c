@@ -1,5 +1,9 @@
 #include <lib/debug.h>
+#include <lib/gcc.h>
+#include <lib/seg.h>
+#include <lib/string.h>
 #include "import.h"
+#include "policy.h"
 
 #define PAGESIZE 4096
 #define VM_USERLO 0x40000000
@@ -7,6 +11,9 @@
 #define VM_USERLO_PI (VM_USERLO / PAGESIZE)
 #define VM_USERHI_PI (VM_USERHI / PAGESIZE)
 
+// Number of pages covered by one word of the free bitmap in the AT.
+#define AT_WORD_BITS 32
+
 /**
  * Allocate a physical page.
  *
@@ -20,42 +27,1868 @@
  *    return 0.
  * 2. Optimize the code using memoization so that you do not have to
  *    scan the allocation table from scratch every time.
+ *
+ * The search starts from the memoized index and is delegated to the
+ * summaries of the free bitmap in the AT, which jump straight to the next
+ * word that has a free page. So the cost of an allocation does not depend
+ * on how much of the memory above the memoized index is already in use.
+ *
+ * With ENABLE_PMM_FREELIST, the AT keeps all free normal pages on a list,
+ * and the page at its head (the most recently freed one) is taken instead.
+ *
+ * Single pages are not taken from the AT one at a time, though: each CPU keeps
+ * a magazine of free pages, which palloc and pfree use without touching the
+ * free bitmap or last_free. The magazine is refilled from the AT and drained
+ * back to it MAG_BATCH pages at a time. The pages in a magazine are marked as
+ * cached in the AT, so they read as unallocated but are never found free there.
+ *
+ * Two more stacks of cached pages back palloc_zeroed:
+ *   zero_pool: pages already filled with zeros by palloc_idle.
+ *   dirty: pages drained from the magazines or freed by pfree_cold,
+ *     waiting to be zeroed.
+ * palloc_idle is run while the console waits for input, so that zeroing a page
+ * is mostly off the allocation path. Both stacks are given back to palloc when
+ * the AT runs out of free pages.
+ *
+ * The pages [VM_USERLO_PI, VM_USERHI_PI) are split into zones by physical address:
+ *   ZONE_DMA: below 16MB, for legacy ISA DMA.
+ *   ZONE_NORMAL: below 2GB, for devices limited to 31-bit addresses.
+ *   ZONE_HIGH: the rest.
+ * Each zone keeps its own memoized index, its last_free. The AT is searched
+ * zone by zone from the highest one, so general allocations leave the low
+ * zones to the callers of palloc_zone, which can only use some of them.
+ * As memory below VM_USERLO is reserved by the kernel, ZONE_DMA is empty
+ * in the current layout. With ENABLE_PMM_FREELIST, palloc takes the head of
+ * the free list whatever its zone.
  */
+#define MAG_SIZE  64
+#define MAG_BATCH 32
 
-unsigned int last_free = VM_USERLO_PI;
-unsigned int palloc()
+// Dispatched to the current policy, see the end of this file.
+unsigned int palloc(void);
+void pfree(unsigned int pfree_index);
+unsigned int palloc_n(unsigned int n);
+unsigned int pfree_deferred_drain(void);
+static unsigned int policy_is_scan(void);
+
+struct magazine
 {
-    if (get_nps() == 0)
+    unsigned int count;
+    unsigned int pages[MAG_SIZE];
+} gcc_aligned(64);
+
+static struct magazine mag[NUM_CPUS];
+static struct magazine zero_pool;
+static struct magazine dirty;
+
+/**
+ * Cache colours: pages whose indices are equal modulo NUM_COLOURS map to the
+ * same sets of a physically indexed cache (the LLC of 1MB, 16-way, or smaller).
+ * palloc_colour keeps one stack of cached pages per colour, so that it can hand
+ * an owner pages of consecutive colours whatever order the free pages are in.
+ * Like the zeroing stacks, they are given back to palloc when the AT runs out.
+ */
+#define NUM_COLOURS 16
+
+// Number of pages taken from the AT at most to find a page of one colour.
+#define COLOUR_MAX_SCAN (2 * NUM_COLOURS)
+
+// Number of pages kept at most per colour, so the stacks hold at most 64 pages.
+#define COLOUR_STACK_SIZE 4
+
+static struct magazine colour_cache[NUM_COLOURS];
+
+#define NUM_ZONES 3
+
+// The zone masks, as in export.h: bit z is set for zones[z].
+#define ZONE_DMA    0x1
+#define ZONE_NORMAL 0x2
+#define ZONE_HIGH   0x4
+#define ZONE_ALL    (ZONE_DMA | ZONE_NORMAL | ZONE_HIGH)
+
+#define ZONE_DMA_HI_PI    (0x01000000 / PAGESIZE)
+#define ZONE_NORMAL_HI_PI (0x80000000 / PAGESIZE)
+
+// Clips a page index to [VM_USERLO_PI, VM_USERHI_PI].
+#define ZONE_CLIP(pi) \
+    ((pi) < VM_USERLO_PI ? VM_USERLO_PI : (pi) > VM_USERHI_PI ? VM_USERHI_PI : (pi))
+
+struct zone
+{
+    unsigned int lo;
+    unsigned int hi;
+    unsigned int last_free;
+};
+
+static struct zone zones[NUM_ZONES] = {
+    { ZONE_CLIP(0), ZONE_CLIP(ZONE_DMA_HI_PI), ZONE_CLIP(0) },
+    { ZONE_CLIP(ZONE_DMA_HI_PI), ZONE_CLIP(ZONE_NORMAL_HI_PI), ZONE_CLIP(ZONE_DMA_HI_PI) },
+    { ZONE_CLIP(ZONE_NORMAL_HI_PI), VM_USERHI_PI, ZONE_CLIP(ZONE_NORMAL_HI_PI) },
+};
+
+/**
+ * Lowers the memoized index of the zone of the page, which has just been
+ * given back to the AT.
+ */
+static void zone_freed(unsigned int page_index)
+{
+    unsigned int z;
+
+    for (z = 0; z < NUM_ZONES; z++)
     {
-        return 0;
+        if (zones[z].lo <= page_index && page_index < zones[z].hi)
+        {
+            if (page_index < zones[z].last_free)
+            {
+                zones[z].last_free = page_index;
+            }
+            return;
+        }
     }
+}
 
-    // TODO: memoization
-    for (unsigned int i = last_free; i < VM_USERHI_PI; i++)
+/**
+ * Returns the first free page of the AT in the highest zone of the mask that
+ * has one, searching each zone from its memoized index, or 0 if there is none.
+ * The page is not marked in any way.
+ */
+static unsigned int zone_next_free(unsigned int zone_mask)
+{
+    unsigned int page_index;
+    unsigned int z = NUM_ZONES;
+
+    while (z-- > 0)
     {
-        if (at_is_norm(i) > 0 && !at_is_allocated(i))
+        if ((zone_mask & (1u << z)) == 0)
         {
-            at_set_allocated(i, 1);
-            last_free = i + 1;
-            return i;
+            continue;
         }
+        page_index = at_next_free(zones[z].last_free);
+        if (page_index < zones[z].hi)
+        {
+            zones[z].last_free = page_index;
+            return page_index;
+        }
+        zones[z].last_free = zones[z].hi;
     }
     return 0;
 }
 
 /**
- * Free a physical page.
- *
- * This function marks the page with given index as unallocated
- * in the allocation table.
+ * Takes a free page out of the AT, marking it as cached.
+ * Returns its index, or 0 if there is no free page.
+ */
+static unsigned int take_free(void)
+{
+    unsigned int page_index;
+
+#ifdef ENABLE_PMM_FREELIST
+    page_index = at_free_head();
+    if (page_index >= VM_USERHI_PI)
+    {
+        return 0;
+    }
+#else
+    page_index = zone_next_free(ZONE_ALL);
+    if (page_index == 0)
+    {
+        return 0;
+    }
+#endif
+    at_set_cached(page_index, 1);
+    return page_index;
+}
+
+/**
+ * 4MB frames: naturally aligned blocks of LARGE_NPAGES pages, to back large pages.
  *
- * Hint: Simple.
+ * So that palloc does not split every such block, whole free blocks are held
+ * in a reserve, up to a target set by palloc_large_reserve, with their pages
+ * marked as cached in the AT. palloc_large takes its blocks from the reserve
+ * first, and pfree_large puts them back while the reserve is below its target.
+ * The reserve is a preference, not a partition: palloc and palloc_n break
+ * reserved blocks up when there is no other free page left. The blocks broken
+ * up are replaced by palloc_idle, one at a time, off the allocation path.
  */
-void pfree(unsigned int pfree_index)
+#define LARGE_NPAGES      1024
+#define LARGE_MAX_RESERVE 64
+
+static unsigned int large_reserve[LARGE_MAX_RESERVE];
+static unsigned int large_nreserved = 0;
+static unsigned int large_target = 0;
+
+// Set when a reserved block is broken up, until palloc_idle finds no block to replace it.
+static unsigned int large_refill = 0;
+
+/**
+ * Returns the first page of the lowest naturally aligned 4MB block in [lo, hi)
+ * whose pages are all normal and free in the AT, or 0 if there is none.
+ * Both lo and hi must be multiples of 4MB.
+ */
+static unsigned int large_find_in(unsigned int lo, unsigned int hi)
+{
+    unsigned int page_index;
+    unsigned int block;
+    unsigned int word_index;
+
+    page_index = at_next_free(lo);
+    while (page_index < hi)
+    {
+        block = page_index & ~(LARGE_NPAGES - 1);
+        for (word_index = block / AT_WORD_BITS;
+             word_index < (block + LARGE_NPAGES) / AT_WORD_BITS;
+             word_index++)
+        {
+            if (at_free_word(word_index) != ~0u)
+            {
+                break;
+            }
+        }
+        if (word_index == (block + LARGE_NPAGES) / AT_WORD_BITS)
+        {
+            return block;
+        }
+        page_index = at_next_free(block + LARGE_NPAGES);
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the first page of a free 4MB block, searching the zones
+ * from the highest one, or 0 if there is none.
+ */
+static unsigned int large_find(void)
+{
+    unsigned int block;
+    unsigned int z = NUM_ZONES;
+
+    while (z-- > 0)
+    {
+        block = large_find_in(zones[z].lo, zones[z].hi);
+        if (block != 0)
+        {
+            return block;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Takes a free block from the AT into the reserve if it is below its target.
+ * Returns 1 if a block was taken, or 0 otherwise.
+ */
+static unsigned int large_fill_one(void)
+{
+    unsigned int block;
+
+    if (large_nreserved >= large_target)
+    {
+        return 0;
+    }
+    block = large_find();
+    if (block == 0)
+    {
+        return 0;
+    }
+    at_set_cached_range(block, block + LARGE_NPAGES, 1);
+    large_reserve[large_nreserved++] = block;
+    return 1;
+}
+
+/**
+ * Takes free blocks from the AT into the reserve until it reaches its target.
+ */
+static void large_fill(void)
+{
+    while (large_fill_one() != 0)
+        ;
+}
+
+/**
+ * Gives the last reserved block back to the AT.
+ * Returns 1, or 0 if the reserve is empty.
+ */
+static unsigned int large_break(void)
+{
+    unsigned int block;
+
+    if (large_nreserved == 0)
+    {
+        return 0;
+    }
+    block = large_reserve[--large_nreserved];
+    at_set_cached_range(block, block + LARGE_NPAGES, 0);
+    zone_freed(block);
+    large_refill = 1;
+    return 1;
+}
+
+/**
+ * Takes a page from the colour stack with the most pages.
+ * Returns its index, or 0 if all the colour stacks are empty.
+ */
+static unsigned int colour_steal(void)
+{
+    unsigned int colour;
+    unsigned int max = 0;
+
+    for (colour = 1; colour < NUM_COLOURS; colour++)
+    {
+        if (colour_cache[colour].count > colour_cache[max].count)
+        {
+            max = colour;
+        }
+    }
+    if (colour_cache[max].count == 0)
+    {
+        return 0;
+    }
+    return colour_cache[max].pages[--colour_cache[max].count];
+}
+
+/**
+ * Takes a page waiting to be zeroed, then a zeroed one, then one kept by
+ * colour. The page is still marked as cached. Returns 0 if there is none.
+ */
+static unsigned int take_parked(void)
+{
+    if (dirty.count > 0)
+    {
+        return dirty.pages[--dirty.count];
+    }
+    if (zero_pool.count > 0)
+    {
+        return zero_pool.pages[--zero_pool.count];
+    }
+    return colour_steal();
+}
+
+/**
+ * Gives the pages waiting to be zeroed, the zeroed ones and the ones kept by
+ * colour back to the AT, or if there are none, breaks up a reserved 4MB block,
+ * so that a policy which takes its pages from the AT can use them.
+ * Returns 0 if there was nothing to give back.
+ */
+static unsigned int park_release(void)
+{
+    unsigned int page_index;
+    unsigned int n = 0;
+
+    while ((page_index = take_parked()) != 0)
+    {
+        at_set_cached(page_index, 0);
+        zone_freed(page_index);
+        n++;
+    }
+    return n != 0 || large_break() != 0;
+}
+
+/**
+ * Moves up to MAG_BATCH free pages from the AT into the empty magazine,
+ * so that the lowest page is handed out first. If the AT runs out,
+ * the pages waiting to be zeroed, then the zeroed ones and then the ones
+ * kept by colour are taken, and then the reserved 4MB blocks are broken up.
+ */
+static void mag_refill(struct magazine *m)
+{
+    unsigned int page_index;
+    unsigned int i;
+
+    while (m->count < MAG_BATCH)
+    {
+        page_index = take_free();
+        if (page_index == 0)
+        {
+            page_index = take_parked();
+        }
+        if (page_index != 0)
+        {
+            m->pages[m->count++] = page_index;
+        }
+        else if (large_break() == 0)
+        {
+            break;
+        }
+    }
+
+    for (i = 0; i < m->count / 2; i++)
+    {
+        page_index = m->pages[i];
+        m->pages[i] = m->pages[m->count - 1 - i];
+        m->pages[m->count - 1 - i] = page_index;
+    }
+}
+
+/**
+ * Gives the n pages at the bottom of the magazine, which were freed
+ * the longest time ago, back to the AT.
+ */
+static void mag_release(struct magazine *m, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        at_set_cached(m->pages[i], 0);
+        zone_freed(m->pages[i]);
+    }
+    for (i = n; i < m->count; i++)
+    {
+        m->pages[i - n] = m->pages[i];
+    }
+    m->count -= n;
+}
+
+/**
+ * Drains the MAG_BATCH oldest pages of the full magazine to the dirty list,
+ * giving the ones that do not fit back to the AT.
+ */
+static void mag_drain(struct magazine *m)
+{
+    unsigned int n = MAG_SIZE - dirty.count;
+    unsigned int i;
+
+    if (n > MAG_BATCH)
+    {
+        n = MAG_BATCH;
+    }
+    for (i = 0; i < n; i++)
+    {
+        dirty.pages[dirty.count++] = m->pages[i];
+    }
+    for (i = n; i < m->count; i++)
+    {
+        m->pages[i - n] = m->pages[i];
+    }
+    m->count -= n;
+    mag_release(m, MAG_BATCH - n);
+}
+
+/**
+ * The LIFO hot-page policy: the page on top of the magazine of the current CPU.
+ */
+static unsigned int lifo_alloc(void)
+{
+    struct magazine *m;
+    unsigned int page_index;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+
+    m = &mag[get_pcpu_idx()];
+    if (m->count == 0)
+    {
+        mag_refill(m);
+        if (m->count == 0)
+        {
+            return 0;
+        }
+    }
+    page_index = m->pages[--m->count];
+    at_set_allocated(page_index, 1);
+    at_set_cached(page_index, 0);
+    return page_index;
+}
+
+/**
+ * The LIFO hot-page policy: a normal page in the user range is pushed on the
+ * magazine of the current CPU, so the next palloc on this CPU returns it while
+ * it is still hot. Any other page is given back to the AT directly.
+ * A page that is not allocated is ignored, so that freeing it twice
+ * does not put it on the magazine twice.
+ */
+static void lifo_free(unsigned int pfree_index)
 {
+    struct magazine *m;
+
+    if (at_is_allocated(pfree_index) == 0)
+    {
+        return;
+    }
+    if (pfree_index < VM_USERLO_PI || pfree_index >= VM_USERHI_PI
+        || at_is_norm(pfree_index) == 0)
+    {
+        at_set_allocated(pfree_index, 0);
+        zone_freed(pfree_index);
+        return;
+    }
+
+    m = &mag[get_pcpu_idx()];
+    if (m->count == MAG_SIZE)
+    {
+        mag_drain(m);
+    }
+    at_set_cached(pfree_index, 1);
     at_set_allocated(pfree_index, 0);
-    if (pfree_index < last_free)
+    m->pages[m->count++] = pfree_index;
+}
+
+/**
+ * The highest reference count the AT can hold, as AT_MAX_REF in MATIntro.
+ * A count that reaches it sticks there, since the references taken past it
+ * are not counted: page_put leaves the page allocated for good instead of
+ * freeing it while some of them may still be in use.
+ */
+#define PAGE_MAX_REF 0xffff
+
+/**
+ * Take one more reference to an allocated page, which is then shared.
+ * Pages that are not allocated are left alone.
+ */
+void page_get(unsigned int page_index)
+{
+    unsigned int ref = at_get_ref(page_index);
+
+    if (ref != 0)
+    {
+        at_set_ref(page_index, ref + 1);
+    }
+}
+
+/**
+ * Drop one reference to an allocated page. When the last reference
+ * is dropped, the page is freed by pfree. A saturated count is left as is.
+ * It must only be used on pages allocated one at a time, not by palloc_n.
+ */
+void page_put(unsigned int page_index)
+{
+    unsigned int ref = at_get_ref(page_index);
+
+    if (ref == PAGE_MAX_REF)
+    {
+        return;
+    }
+    if (ref > 1)
+    {
+        at_set_ref(page_index, ref - 1);
+    }
+    else if (ref == 1)
+    {
+        pfree(page_index);
+    }
+}
+
+/**
+ * The free-run index used by fit_alloc_n and palloc_range is the set of free
+ * extents kept by the MATExtent layer, seeded by pmem_init with the usable
+ * ranges of the memory map.
+ *
+ * Only fit_alloc_n, fit_free_n and palloc_range update the extents. Pages taken by palloc or by
+ * other allocators are still found in them, so an extent is only a hint, and a
+ * range taken from it is checked against the free bitmap in the AT before use.
+ * The pages of a stale range that are still free are recorded again, which
+ * drops the allocated pages from the extents for good. If no extent is long
+ * enough, the extents are rebuilt from the AT once before giving up, after the
+ * magazine of the current CPU, the zeroing and colour stacks and the reserved
+ * 4MB blocks are drained so that their pages can be merged.
+ * A free run that finds no extent node left is only in the AT, so once that
+ * happens, an allocation that fails on the extents searches the AT instead,
+ * until a rebuild manages to record all the runs again.
+ */
+
+// Set when a free run could not be recorded since all the extent nodes were in use.
+static unsigned int fit_lost = 0;
+
+/**
+ * Returns the number of consecutive normal and unallocated pages
+ * starting from the given page, counting no further than the limit.
+ */
+static unsigned int run_length(unsigned int start, unsigned int limit)
+{
+    unsigned int page_index = start;
+    unsigned int used;
+
+    while (page_index < limit)
+    {
+        used = ~at_free_word(page_index / AT_WORD_BITS) >> (page_index % AT_WORD_BITS);
+        if (used != 0)
+        {
+            page_index += __builtin_ctz(used);
+            break;
+        }
+        page_index = (page_index / AT_WORD_BITS + 1) * AT_WORD_BITS;
+    }
+
+    return (page_index < limit ? page_index : limit) - start;
+}
+
+/**
+ * Records the pages [start, start + len) as a free extent,
+ * or sets fit_lost if there is no node left for them.
+ */
+static void fit_record(unsigned int start, unsigned int len)
+{
+    if (extent_free(start, len) == 0)
+    {
+        fit_lost = 1;
+    }
+}
+
+/**
+ * Searches the AT for the lowest run of n normal and unallocated pages
+ * [p, p + n) with lo <= p, p + n <= hi and p a multiple of align.
+ * Returns p, or 0 if there is no such run.
+ */
+static unsigned int run_search(unsigned int lo, unsigned int hi, unsigned int n, unsigned int align)
+{
+    unsigned int page_index = lo;
+    unsigned int len;
+
+    if (align == 0)
+    {
+        align = 1;
+    }
+
+    while (1)
+    {
+        page_index = at_next_free(page_index);
+        page_index = (page_index + align - 1) / align * align;
+        if (page_index >= hi || n > hi - page_index)
+        {
+            return 0;
+        }
+        len = run_length(page_index, page_index + n);
+        if (len == n)
+        {
+            return page_index;
+        }
+        page_index += len + 1;
+    }
+}
+
+/**
+ * Records every run of normal and unallocated pages in [lo, hi) as a free extent.
+ */
+static void run_record(unsigned int lo, unsigned int hi)
+{
+    unsigned int page_index;
+    unsigned int len;
+
+    page_index = at_next_free(lo);
+    while (page_index < hi)
+    {
+        len = run_length(page_index, hi);
+        fit_record(page_index, len);
+        page_index = at_next_free(page_index + len);
+    }
+}
+
+/**
+ * Drains the magazine of the current CPU, the zeroing and colour stacks and
+ * the reserved 4MB blocks, and rebuilds the free extents from the AT.
+ */
+static void fit_rebuild(void)
+{
+    struct magazine *m = &mag[get_pcpu_idx()];
+    unsigned int colour;
+
+    mag_release(m, m->count);
+    mag_release(&dirty, dirty.count);
+    mag_release(&zero_pool, zero_pool.count);
+    for (colour = 0; colour < NUM_COLOURS; colour++)
+    {
+        mag_release(&colour_cache[colour], colour_cache[colour].count);
+    }
+    while (large_break() != 0)
+        ;
+    extent_clear();
+    fit_lost = 0;
+    run_record(VM_USERLO_PI, VM_USERHI_PI);
+}
+
+/**
+ * Takes n physically contiguous physical pages best-fit from the free extents.
+ *
+ * If a range taken from an extent turns out not to be all free in the AT,
+ * its free pages are put back and the next extent is tried. Returns the index
+ * of the first page, or 0 if there is no free run of n pages.
+ */
+static unsigned int fit_alloc_n(unsigned int n)
+{
+    unsigned int page_index;
+    unsigned int rebuilt = 0;
+
+    if (n == 0 || get_nps() == 0)
+    {
+        return 0;
+    }
+
+    while (1)
+    {
+        page_index = extent_alloc_best(n);
+        if (page_index == 0)
+        {
+            if (rebuilt)
+            {
+                page_index = fit_lost ? run_search(VM_USERLO_PI, VM_USERHI_PI, n, 1) : 0;
+                if (page_index == 0)
+                {
+                    return 0;
+                }
+                break;
+            }
+            fit_rebuild();
+            rebuilt = 1;
+            continue;
+        }
+        if (run_length(page_index, page_index + n) == n)
+        {
+            break;
+        }
+        run_record(page_index, page_index + n);
+    }
+
+    at_set_allocated_range(page_index, page_index + n, 1);
+    return page_index;
+}
+
+/**
+ * Gives n physically contiguous physical pages back to the AT, and records
+ * them as one free extent, which is merged with the free extents next to it.
+ */
+static void fit_free_n(unsigned int pfree_index, unsigned int n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+
+    at_set_allocated_range(pfree_index, pfree_index + n, 0);
+    zone_freed(pfree_index);
+
+    fit_record(pfree_index, n);
+}
+
+/**
+ * Allocate n physical pages, not necessarily contiguous, and store their
+ * indices in out.
+ *
+ * Under lifo and nextfit, the pages in the magazine of the current CPU are
+ * taken first. The rest are taken in one walk over the free bitmap from the
+ * last_free of each zone, from the highest one: each run of free pages is
+ * marked as allocated with one update per word of the bitmap, and the
+ * last_free of each zone is only updated once at the end. The other policies
+ * keep their own account of the free pages, so the pages are taken one by one
+ * with palloc. Returns the number of pages allocated,
+ * which is less than n only if the memory runs out.
+ */
+unsigned int palloc_batch(unsigned int *out, unsigned int n)
+{
+    struct magazine *m;
+    unsigned int count = 0;
+    unsigned int page_index;
+    unsigned int len;
+    unsigned int z;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+    if (policy_is_scan() == 0)
+    {
+        while (count < n && (page_index = palloc()) != 0)
+        {
+            out[count++] = page_index;
+        }
+        return count;
+    }
+
+    m = &mag[get_pcpu_idx()];
+    while (count < n && m->count > 0)
+    {
+        page_index = m->pages[--m->count];
+        at_set_allocated(page_index, 1);
+        at_set_cached(page_index, 0);
+        out[count++] = page_index;
+    }
+    if (count == n)
+    {
+        return count;
+    }
+
+    z = NUM_ZONES;
+    while (count < n && z-- > 0)
+    {
+        page_index = at_next_free(zones[z].last_free);
+        while (count < n && page_index < zones[z].hi)
+        {
+            len = run_length(page_index, page_index + (n - count) < zones[z].hi
+                                         ? page_index + (n - count) : zones[z].hi);
+            at_set_allocated_range(page_index, page_index + len, 1);
+            while (len > 0)
+            {
+                out[count++] = page_index++;
+                len--;
+            }
+            if (count < n)
+            {
+                page_index = at_next_free(page_index);
+            }
+        }
+        zones[z].last_free = page_index < zones[z].hi ? page_index : zones[z].hi;
+    }
+
+    return count;
+}
+
+/**
+ * Sorts the page indices in ascending order (heapsort, in place).
+ */
+static void sort_pages(unsigned int *pages, unsigned int n)
+{
+    unsigned int start = n / 2;
+    unsigned int end = n;
+    unsigned int root;
+    unsigned int child;
+    unsigned int tmp;
+
+    while (end > 1)
+    {
+        if (start > 0)
+        {
+            start--;
+        }
+        else
+        {
+            end--;
+            tmp = pages[0];
+            pages[0] = pages[end];
+            pages[end] = tmp;
+        }
+
+        root = start;
+        while ((child = 2 * root + 1) < end)
+        {
+            if (child + 1 < end && pages[child + 1] > pages[child])
+            {
+                child++;
+            }
+            if (pages[root] >= pages[child])
+            {
+                break;
+            }
+            tmp = pages[root];
+            pages[root] = pages[child];
+            pages[child] = tmp;
+            root = child;
+        }
+    }
+}
+
+/**
+ * Sorts the page indices in ascending order, and drops the pages that cannot
+ * be freed: those that are not allocated or are held in a page cache, and
+ * the repeats of a page. Returns the number of pages left at the front.
+ */
+static unsigned int sort_allocated(unsigned int *pages, unsigned int n)
+{
+    unsigned int kept = 0;
+    unsigned int i;
+
+    // teardown paths often free their pages in address order already
+    for (i = 1; i < n && pages[i - 1] < pages[i]; i++)
+        ;
+    if (i < n)
+    {
+        sort_pages(pages, n);
+    }
+    for (i = 0; i < n; i++)
+    {
+        if ((kept == 0 || pages[i] != pages[kept - 1])
+            && at_is_allocated(pages[i]) != 0 && at_is_cached(pages[i]) == 0)
+        {
+            pages[kept++] = pages[i];
+        }
+    }
+    return kept;
+}
+
+/**
+ * Free the n physical pages whose indices are in pages.
+ *
+ * The array is sorted in place first, and the pages that are not allocated,
+ * or are given more than once, are dropped from it. Under lifo and nextfit,
+ * each run of consecutive pages is then given back to the AT with one update
+ * per word of the free bitmap, and the last_free of its zone is only checked
+ * once. The pages do not go through the magazine, which could only keep a few
+ * of them. Under the other policies, each page is given back with pfree.
+ */
+void pfree_batch(unsigned int *pages, unsigned int n)
+{
+    unsigned int i = 0;
+    unsigned int j;
+
+    n = sort_allocated(pages, n);
+    if (n == 0)
+    {
+        return;
+    }
+    if (policy_is_scan() == 0)
+    {
+        for (i = 0; i < n; i++)
+        {
+            pfree(pages[i]);
+        }
+        return;
+    }
+
+    while (i < n)
+    {
+        j = i + 1;
+        while (j < n && pages[j] == pages[j - 1] + 1)
+        {
+            j++;
+        }
+        at_set_allocated_range(pages[i], pages[j - 1] + 1, 0);
+        zone_freed(pages[i]);
+        i = j;
+    }
+}
+
+/**
+ * Watermarks and shrinkers.
+ *
+ * The free pages are the free pages of the AT plus the pages held in the page
+ * caches of this layer, which palloc can still hand out. Subsystems that keep
+ * memory they could give back register a shrinker, which frees up to the
+ * given number of pages and returns how many it freed.
+ *   Below wmark_low: the shrinkers are run from palloc_idle.
+ *   Below wmark_min: they are run by the allocating call itself.
+ *   Out of memory: they are run once more before palloc or palloc_n gives up.
+ * In each case they are run until there are wmark_high free pages again,
+ * or until a whole pass over them frees nothing. All the watermarks are 0,
+ * so the shrinkers are only run when memory runs out, until set by
+ * palloc_set_watermarks.
+ */
+#define PALLOC_MAX_SHRINKERS 8
+
+static unsigned int wmark_min = 0;
+static unsigned int wmark_low = 0;
+static unsigned int wmark_high = 0;
+
+static unsigned int (*shrinkers[PALLOC_MAX_SHRINKERS])(unsigned int npages);
+static unsigned int nshrinkers = 0;
+
+static unsigned int reclaim_pending = 0;
+static unsigned int reclaiming = 0;
+
+static unsigned int free_pages(void)
+{
+    return at_nfree_pages() + at_ncached_pages();
+}
+
+/**
+ * Gives back the pages waiting in the deferred-free queue of the current CPU,
+ * but not those queued on the other CPUs, which only they can drain,
+ * then runs the shrinkers until at least npages pages are freed, or a whole
+ * pass over them frees nothing. Returns the number of pages freed.
+ */
+static unsigned int reclaim(unsigned int npages)
+{
+    unsigned int freed;
+    unsigned int pass;
+    unsigned int i;
+
+    if (reclaiming)
+    {
+        return 0;
+    }
+    reclaiming = 1;
+    freed = pfree_deferred_drain();
+    while (freed < npages)
+    {
+        pass = 0;
+        for (i = 0; i < nshrinkers && freed + pass < npages; i++)
+        {
+            pass += shrinkers[i](npages - freed - pass);
+        }
+        if (pass == 0)
+        {
+            break;
+        }
+        freed += pass;
+    }
+    reclaiming = 0;
+    return freed;
+}
+
+/**
+ * Returns the number of pages to free to get back to the high watermark,
+ * and at least the given number.
+ */
+static unsigned int reclaim_target(unsigned int at_least)
+{
+    unsigned int nfree = free_pages();
+
+    if (wmark_high > nfree && wmark_high - nfree > at_least)
+    {
+        return wmark_high - nfree;
+    }
+    return at_least;
+}
+
+/**
+ * Checks the free pages against the watermarks before an allocation.
+ */
+static void wmark_check(void)
+{
+    unsigned int nfree = free_pages();
+
+    if (nfree >= wmark_low)
+    {
+        return;
+    }
+    if (nfree < wmark_min)
+    {
+        reclaim(reclaim_target(0));
+    }
+    else
+    {
+        reclaim_pending = 1;
+    }
+}
+
+/**
+ * Sets the watermarks, in pages. They are raised as needed so that
+ * min <= low <= high.
+ */
+void palloc_set_watermarks(unsigned int min, unsigned int low, unsigned int high)
+{
+    wmark_min = min;
+    wmark_low = low > min ? low : min;
+    wmark_high = high > wmark_low ? high : wmark_low;
+}
+
+/**
+ * Adds a shrinker, called with the number of pages to free, which returns
+ * the number of pages it freed. The shrinkers are called in the order they
+ * were registered. Returns 1, or 0 if the table of shrinkers is full.
+ */
+unsigned int palloc_shrinker_register(unsigned int (*shrink)(unsigned int npages))
+{
+    if (nshrinkers == PALLOC_MAX_SHRINKERS)
+    {
+        return 0;
+    }
+    shrinkers[nshrinkers++] = shrink;
+    return 1;
+}
+
+/**
+ * Allocate a physical page that is likely not in the caches, for callers that
+ * overwrite the whole page without reading it first, such as DMA targets.
+ *
+ * The page is taken from the AT, or else from the dirty list, so the hot pages
+ * on the magazines are left to palloc. Returns 0 if there is no free page.
+ */
+unsigned int palloc_cold(void)
+{
+    unsigned int page_index;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+
+    page_index = take_free();
+    if (page_index == 0)
+    {
+        if (dirty.count == 0)
+        {
+            return palloc();
+        }
+        page_index = dirty.pages[--dirty.count];
+    }
+    at_set_allocated(page_index, 1);
+    at_set_cached(page_index, 0);
+    return page_index;
+}
+
+/**
+ * Free a physical page whose contents are not in the caches, such as a page
+ * allocated by palloc_cold. It goes to the dirty list if there is room,
+ * and to the AT otherwise, so that it does not push the hot pages
+ * off the magazine of the current CPU. A page that is not allocated is ignored.
+ */
+void pfree_cold(unsigned int pfree_index)
+{
+    if (at_is_allocated(pfree_index) == 0)
+    {
+        return;
+    }
+    if (pfree_index < VM_USERLO_PI || pfree_index >= VM_USERHI_PI
+        || at_is_norm(pfree_index) == 0 || dirty.count == MAG_SIZE)
+    {
+        at_set_allocated(pfree_index, 0);
+        zone_freed(pfree_index);
+        return;
+    }
+
+    at_set_cached(pfree_index, 1);
+    at_set_allocated(pfree_index, 0);
+    dirty.pages[dirty.count++] = pfree_index;
+}
+
+/**
+ * Allocate a physical page filled with zeros.
+ *
+ * A page zeroed ahead of time by palloc_idle is taken if there is one,
+ * otherwise a page is allocated by palloc and zeroed here.
+ * Returns 0 if there is no free page.
+ */
+unsigned int palloc_zeroed(void)
+{
+    unsigned int page_index;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+
+    if (zero_pool.count > 0)
+    {
+        page_index = zero_pool.pages[--zero_pool.count];
+        at_set_allocated(page_index, 1);
+        at_set_cached(page_index, 0);
+        return page_index;
+    }
+
+    page_index = palloc();
+    if (page_index != 0)
+    {
+        memzero((void *) (page_index * PAGESIZE), PAGESIZE);
+    }
+    return page_index;
+}
+
+/**
+ * Zeroes one page for the pool of palloc_zeroed, if the pool is not full.
+ * The page is taken from the dirty list, or else from the AT.
+ * It is meant to be called repeatedly while the CPU has nothing else to do.
+ * If the free pages fell below the low watermark, it runs the shrinkers instead,
+ * and if pages were freed with pfree_deferred, it gives them back first.
+ * Then, if reserved 4MB blocks were broken up, it replaces one of them.
+ */
+void palloc_idle(void)
+{
+    unsigned int page_index;
+
+    if (pfree_deferred_drain() != 0)
+    {
+        return;
+    }
+    if (reclaim_pending)
+    {
+        reclaim_pending = 0;
+        reclaim(reclaim_target(0));
+        return;
+    }
+    if (large_refill)
+    {
+        large_refill = large_fill_one() != 0 && large_nreserved < large_target;
+        return;
+    }
+    if (get_nps() == 0 || zero_pool.count == MAG_SIZE)
+    {
+        return;
+    }
+
+    if (dirty.count > 0)
+    {
+        page_index = dirty.pages[--dirty.count];
+    }
+    else
+    {
+        page_index = take_free();
+        if (page_index == 0)
+        {
+            return;
+        }
+    }
+    memzero((void *) (page_index * PAGESIZE), PAGESIZE);
+    zero_pool.pages[zero_pool.count++] = page_index;
+}
+
+/**
+ * Allocate a naturally aligned 4MB frame of 1024 physical pages.
+ *
+ * The frame is taken from the reserve if it is not empty, otherwise the lowest
+ * free block is taken from the AT. The reserve is then topped up again.
+ * Returns the index of the first page, or 0 if there is no free block.
+ */
+unsigned int palloc_large(void)
+{
+    unsigned int block;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+
+    if (large_nreserved > 0)
+    {
+        block = large_reserve[--large_nreserved];
+        at_set_allocated_range(block, block + LARGE_NPAGES, 1);
+        at_set_cached_range(block, block + LARGE_NPAGES, 0);
+    }
+    else
+    {
+        block = large_find();
+        if (block == 0)
+        {
+            return 0;
+        }
+        at_set_allocated_range(block, block + LARGE_NPAGES, 1);
+    }
+
+    large_fill();
+    return block;
+}
+
+/**
+ * Free a 4MB frame allocated by palloc_large.
+ * It goes back to the reserve if the reserve is below its target,
+ * otherwise it is given back to the AT and recorded as a free extent.
+ */
+void pfree_large(unsigned int block)
+{
+    if (large_nreserved < large_target)
+    {
+        at_set_cached_range(block, block + LARGE_NPAGES, 1);
+        at_set_allocated_range(block, block + LARGE_NPAGES, 0);
+        large_reserve[large_nreserved++] = block;
+        return;
+    }
+
+    at_set_allocated_range(block, block + LARGE_NPAGES, 0);
+    zone_freed(block);
+    fit_record(block, LARGE_NPAGES);
+}
+
+/**
+ * Sets the number of free 4MB blocks to keep in the reserve, up to 64,
+ * and takes or gives back blocks to reach it.
+ * Returns the number of blocks in the reserve, which is less than asked
+ * if the AT does not have enough free blocks.
+ */
+unsigned int palloc_large_reserve(unsigned int nblocks)
+{
+    large_target = nblocks < LARGE_MAX_RESERVE ? nblocks : LARGE_MAX_RESERVE;
+    while (large_nreserved > large_target)
+    {
+        large_break();
+    }
+    if (get_nps() != 0)
+    {
+        large_fill();
+    }
+    return large_nreserved;
+}
+
+/**
+ * Allocate a physical page from one of the zones in the mask.
+ *
+ * The zones are tried from the highest one. Unless all the zones are allowed,
+ * the page is taken straight from the AT, not from the magazine, whose pages
+ * may be in any zone. Returns 0 if there is no free page in those zones.
+ */
+unsigned int palloc_zone(unsigned int zone_mask)
+{
+    unsigned int page_index;
+
+    if ((zone_mask & ZONE_ALL) == ZONE_ALL)
+    {
+        return palloc();
+    }
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+
+    page_index = zone_next_free(zone_mask);
+    if (page_index != 0)
+    {
+        at_set_allocated(page_index, 1);
+    }
+    return page_index;
+}
+
+/**
+ * Returns the number of free pages of the AT in the zones of the mask.
+ * The pages held in the magazines and the other page caches are not counted.
+ */
+unsigned int zone_free_pages(unsigned int zone_mask)
+{
+    unsigned int nfree = 0;
+    unsigned int word_index;
+    unsigned int word;
+    unsigned int z;
+
+    for (z = 0; z < NUM_ZONES; z++)
+    {
+        if ((zone_mask & (1u << z)) == 0)
+        {
+            continue;
+        }
+        // the zone boundaries are multiples of 32 pages
+        for (word_index = zones[z].lo / AT_WORD_BITS;
+             word_index < zones[z].hi / AT_WORD_BITS;
+             word_index++)
+        {
+            word = at_free_word(word_index);
+            if (word != 0)
+            {
+                nfree += __builtin_popcount(word);
+            }
+        }
+    }
+    return nfree;
+}
+
+/**
+ * Takes free pages from the AT into the colour stacks, each into the stack of
+ * its colour, until there is one of the given colour. Free pages are mostly
+ * taken in ascending order, so this seldom takes more than NUM_COLOURS pages.
+ * It gives up after COLOUR_MAX_SCAN of them, or once it takes a page whose
+ * stack is full, which it gives back to the AT.
+ */
+static void colour_refill(unsigned int colour)
+{
+    struct magazine *cc;
+    unsigned int page_index;
+    unsigned int n;
+
+    for (n = 0; n < COLOUR_MAX_SCAN && colour_cache[colour].count == 0; n++)
+    {
+        page_index = take_free();
+        if (page_index == 0)
+        {
+            return;
+        }
+        cc = &colour_cache[page_index % NUM_COLOURS];
+        if (cc->count == COLOUR_STACK_SIZE)
+        {
+            at_set_cached(page_index, 0);
+            zone_freed(page_index);
+            return;
+        }
+        cc->pages[cc->count++] = page_index;
+    }
+}
+
+/**
+ * Allocate a physical page of the cache colour *colour, the page index modulo
+ * NUM_COLOURS, and advance *colour to the next colour.
+ *
+ * Each owner keeps its own cursor, starting from any value, so that the pages
+ * it allocates one after another are spread over all the cache colours, and
+ * the same offsets in them do not compete for the same cache sets.
+ * If there is no free page of that colour, the next colour that has one is
+ * used, and the cursor moves past it. Returns 0 if there is no free page.
+ */
+unsigned int palloc_colour(unsigned int *colour)
+{
+    unsigned int page_index;
+    unsigned int c = *colour % NUM_COLOURS;
+    unsigned int i;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+
+    if (colour_cache[c].count == 0)
+    {
+        colour_refill(c);
+    }
+    for (i = 0; i < NUM_COLOURS; i++)
+    {
+        if (colour_cache[(c + i) % NUM_COLOURS].count > 0)
+        {
+            break;
+        }
+    }
+    if (i == NUM_COLOURS)
+    {
+        page_index = palloc();
+        if (page_index != 0)
+        {
+            *colour = (page_index + 1) % NUM_COLOURS;
+        }
+        return page_index;
+    }
+
+    c = (c + i) % NUM_COLOURS;
+    page_index = colour_cache[c].pages[--colour_cache[c].count];
+    at_set_allocated(page_index, 1);
+    at_set_cached(page_index, 0);
+    *colour = (c + 1) % NUM_COLOURS;
+    return page_index;
+}
+
+/**
+ * Allocate n physically contiguous physical pages [p, p + n) inside the window
+ * [lo, hi) of page indices, with p a multiple of align (align 0 is taken as 1).
+ *
+ * The lowest such range is looked up in the free extents by address, so the
+ * cost does not depend on how many pages below lo or in the window are in use.
+ * As for palloc_n, a range found in a stale extent is checked against the AT,
+ * and the extents are rebuilt once before giving up. The pages are not
+ * counted by the allocation policy, and must be freed by pfree_range.
+ * Returns p, or 0 if there is no such range.
+ */
+unsigned int palloc_range(unsigned int lo, unsigned int hi, unsigned int n, unsigned int align)
+{
+    unsigned int page_index;
+    unsigned int rebuilt = 0;
+
+    if (n == 0 || get_nps() == 0)
+    {
+        return 0;
+    }
+
+    lo = ZONE_CLIP(lo);
+    hi = ZONE_CLIP(hi);
+    if (lo >= hi || n > hi - lo)
+    {
+        return 0;
+    }
+    while (1)
+    {
+        page_index = extent_alloc_range(lo, hi, n, align);
+        if (page_index == 0)
+        {
+            if (rebuilt)
+            {
+                page_index = fit_lost ? run_search(lo, hi, n, align) : 0;
+                if (page_index == 0)
+                {
+                    return 0;
+                }
+                break;
+            }
+            fit_rebuild();
+            rebuilt = 1;
+            continue;
+        }
+        if (run_length(page_index, page_index + n) == n)
+        {
+            break;
+        }
+        run_record(page_index, page_index + n);
+    }
+
+    at_set_allocated_range(page_index, page_index + n, 1);
+    return page_index;
+}
+
+/**
+ * Free n physically contiguous physical pages allocated by palloc_range.
+ */
+void pfree_range(unsigned int pfree_index, unsigned int n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    fit_free_n(pfree_index, n);
+}
+
+/**
+ * Per-owner accounting: the AT counts the allocated pages of each owner tag,
+ * and their highest count so far. The pages are counted for owner 0 until they
+ * are tagged, so any allocation function can be followed by palloc_set_owner.
+ */
+
+/**
+ * Allocate a physical page with palloc, and tag it with the given owner.
+ */
+unsigned int palloc_owner(unsigned int owner)
+{
+    unsigned int page_index = palloc();
+
+    if (page_index != 0)
+    {
+        at_set_owner_range(page_index, page_index + 1, owner);
+    }
+    return page_index;
+}
+
+/**
+ * Allocate n physically contiguous pages with palloc_n,
+ * and tag them with the given owner.
+ */
+unsigned int palloc_n_owner(unsigned int n, unsigned int owner)
+{
+    unsigned int page_index = palloc_n(n);
+
+    if (page_index != 0)
+    {
+        at_set_owner_range(page_index, page_index + n, owner);
+    }
+    return page_index;
+}
+
+/**
+ * Tags the n allocated pages starting from the given one with the owner.
+ */
+void palloc_set_owner(unsigned int page_index, unsigned int n, unsigned int owner)
+{
+    at_set_owner_range(page_index, page_index + n, owner);
+}
+
+/**
+ * Returns the number of allocated pages of the owner,
+ * and through peak, the highest number it has had.
+ */
+unsigned int palloc_owner_pages(unsigned int owner, unsigned int *peak)
+{
+    return at_owner_pages(owner, peak);
+}
+
+/**
+ * Allocation policies.
+ *
+ * palloc, pfree, palloc_n and pfree_n go through the ops table of the current
+ * policy, so that policies can be compared on the same workload without
+ * rebuilding the rest of the kernel. The policies of this layer are:
+ *   lifo: the magazines in front of the next-fit scan (the default).
+ *   nextfit: the next-fit scan of the AT from the last_free of each zone.
+ *   bestfit: single pages taken best-fit from the free extents, like palloc_n.
+ * When the policy runs out, the pages waiting to be zeroed or kept by colour
+ * are given back to the AT and the reserved 4MB blocks are broken up, as the
+ * magazines do when they are refilled, before palloc and palloc_n give up.
+ * Upper layers may register more with palloc_policy_register.
+ *
+ * Pages are only handed out by the policy that holds them, so the policy may
+ * only be changed before the first allocation through it, i.e. at boot.
+ * The other allocation functions of this layer go straight to the AT, and any
+ * policy frees the single pages they return.
+ */
+#define PALLOC_MAX_POLICIES 8
+
+static unsigned int nextfit_alloc(void)
+{
+    unsigned int page_index;
+
+    if (get_nps() == 0)
+    {
+        return 0;
+    }
+    page_index = zone_next_free(ZONE_ALL);
+    if (page_index != 0)
+    {
+        at_set_allocated(page_index, 1);
+    }
+    return page_index;
+}
+
+static void nextfit_free(unsigned int pfree_index)
+{
+    at_set_allocated(pfree_index, 0);
+    zone_freed(pfree_index);
+}
+
+static unsigned int bestfit_alloc(void)
+{
+    return fit_alloc_n(1);
+}
+
+static void bestfit_free(unsigned int pfree_index)
+{
+    fit_free_n(pfree_index, 1);
+}
+
+static void lifo_stats(struct palloc_stats *stats)
+{
+    unsigned int cpu;
+    unsigned int colour;
+
+    stats->cached = dirty.count + zero_pool.count;
+    for (cpu = 0; cpu < NUM_CPUS; cpu++)
+    {
+        stats->cached += mag[cpu].count;
+    }
+    for (colour = 0; colour < NUM_COLOURS; colour++)
+    {
+        stats->cached += colour_cache[colour].count;
+    }
+}
+
+static void nocache_stats(struct palloc_stats *stats)
+{
+    stats->cached = 0;
+}
+
+static const struct palloc_ops lifo_ops = {
+    "lifo", lifo_alloc, lifo_free, fit_alloc_n, fit_free_n, lifo_stats
+};
+
+static const struct palloc_ops nextfit_ops = {
+    "nextfit", nextfit_alloc, nextfit_free, fit_alloc_n, fit_free_n, nocache_stats
+};
+
+static const struct palloc_ops bestfit_ops = {
+    "bestfit", bestfit_alloc, bestfit_free, fit_alloc_n, fit_free_n, nocache_stats
+};
+
+static const struct palloc_ops *policies[PALLOC_MAX_POLICIES] = {
+    &lifo_ops, &nextfit_ops, &bestfit_ops,
+};
+static unsigned int npolicies = 3;
+
+static const struct palloc_ops *policy = &lifo_ops;
+
+/**
+ * Returns 1 if the current policy hands out the free pages of the AT as the
+ * next-fit scan finds them, with no account of them besides the magazines,
+ * so that palloc_batch and pfree_batch can go to the AT directly.
+ */
+static unsigned int policy_is_scan(void)
+{
+    return policy == &lifo_ops || policy == &nextfit_ops;
+}
+
+// The counters of palloc_stats, for the current policy.
+static unsigned int policy_nalloc = 0;
+static unsigned int policy_nfreed = 0;
+static unsigned int policy_nfailed = 0;
+
+/**
+ * Adds a policy that can then be selected by its name.
+ * Returns 1, or 0 if the table of policies is full.
+ */
+unsigned int palloc_policy_register(const struct palloc_ops *ops)
+{
+    if (npolicies == PALLOC_MAX_POLICIES)
+    {
+        return 0;
+    }
+    policies[npolicies++] = ops;
+    return 1;
+}
+
+/**
+ * Makes the policy with the given name the current one.
+ * Returns 1, or 0 if there is no such policy, or if pages have already been
+ * allocated through the current one.
+ */
+unsigned int palloc_policy_select(const char *name)
+{
+    unsigned int i;
+
+    if (policy_nalloc != 0)
+    {
+        return 0;
+    }
+    for (i = 0; i < npolicies; i++)
+    {
+        if (strcmp(policies[i]->name, name) == 0)
+        {
+            policy = policies[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the name of the current policy.
+ */
+const char *palloc_policy_name(void)
+{
+    return policy->name;
+}
+
+/**
+ * Fills in the counters of the current policy, the number of free pages
+ * in the AT, and the number of free pages held by the policy itself.
+ */
+void palloc_stats(struct palloc_stats *stats)
+{
+    stats->nalloc = policy_nalloc;
+    stats->nfreed = policy_nfreed;
+    stats->nfailed = policy_nfailed;
+    stats->at_free = zone_free_pages(ZONE_ALL);
+    policy->stats(stats);
+}
+
+/**
+ * Allocate a physical page with the current policy.
+ * Returns the index of the page, or 0 if there is no free page
+ * even after running the shrinkers and giving back the parked pages.
+ */
+unsigned int palloc()
+{
+    unsigned int page_index;
+
+    wmark_check();
+    page_index = policy->alloc();
+    if (page_index == 0 && reclaim(reclaim_target(1)) != 0)
+    {
+        page_index = policy->alloc();
+    }
+    while (page_index == 0 && park_release() != 0)
+    {
+        page_index = policy->alloc();
+    }
+    if (page_index != 0)
+    {
+        policy_nalloc++;
+    }
+    else
+    {
+        policy_nfailed++;
+    }
+    return page_index;
+}
+
+/**
+ * Free a physical page.
+ *
+ * This function marks the page with given index as unallocated
+ * in the allocation table, or keeps it for the next palloc,
+ * depending on the current policy. A page that is not allocated is ignored,
+ * so that freeing it twice does not give it to the policy twice.
+ */
+void pfree(unsigned int pfree_index)
+{
+    if (at_is_allocated(pfree_index) == 0)
+    {
+        return;
+    }
+    policy_nfreed++;
+    policy->free(pfree_index);
+}
+
+/**
+ * Allocate n physically contiguous physical pages with the current policy.
+ * Returns the index of the first page, or 0 if there is no free run of n pages
+ * even after running the shrinkers and giving back the parked pages.
+ */
+unsigned int palloc_n(unsigned int n)
+{
+    unsigned int page_index;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    wmark_check();
+    page_index = policy->alloc_n(n);
+    if (page_index == 0 && reclaim(reclaim_target(n)) != 0)
+    {
+        page_index = policy->alloc_n(n);
+    }
+    while (page_index == 0 && park_release() != 0)
+    {
+        page_index = policy->alloc_n(n);
+    }
+    if (page_index != 0)
+    {
+        policy_nalloc += n;
+    }
+    else
+    {
+        policy_nfailed++;
+    }
+    return page_index;
+}
+
+/**
+ * Free n physically contiguous physical pages allocated by palloc_n.
+ */
+void pfree_n(unsigned int pfree_index, unsigned int n)
+{
+    if (n == 0)
+    {
+        return;
+    }
+    policy_nfreed += n;
+    policy->free_n(pfree_index, n);
+}
+
+/**
+ * Deferred free: pfree_deferred only pushes the page on a queue of the current
+ * CPU, which no other CPU touches, so it takes no lock and does not touch the AT.
+ * The pages stay allocated in the AT until the queue is drained, by palloc_idle,
+ * by reclaim when memory runs low, or by pfree_deferred itself when the queue
+ * is full, always on the CPU that queued them: the pages queued on another CPU
+ * cannot be reclaimed until that CPU drains its queue. The drain sorts the
+ * queue and drops the pages that pfree would ignore, so that each run of
+ * consecutive pages is given back with one update per word of the free bitmap,
+ * and the last_free of its zone and the free extents are updated once per run.
+ */
+#define DEFER_SIZE 512
+
+struct defer_queue
+{
+    unsigned int count;
+    unsigned int pages[DEFER_SIZE];
+} gcc_aligned(64);
+
+static struct defer_queue deferred[NUM_CPUS];
+
+/**
+ * Gives the pages in the deferred-free queue of the current CPU back.
+ * The pages that are not allocated, or held in a page cache, and the pages
+ * queued more than once are only given back once, if at all.
+ *
+ * The built-in policies take any run of pages back with fit_free_n. A policy
+ * registered by an upper layer, such as the buddy allocator, may only take back
+ * what it handed out, so it is given the pages one at a time, in address order.
+ * Returns the number of pages freed.
+ */
+unsigned int pfree_deferred_drain(void)
+{
+    struct defer_queue *q = &deferred[get_pcpu_idx()];
+    unsigned int n = q->count;
+    unsigned int i = 0;
+    unsigned int j;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    n = sort_allocated(q->pages, n);
+    while (i < n)
+    {
+        j = i + 1;
+        if (policy->free_n == fit_free_n)
+        {
+            while (j < n && q->pages[j] == q->pages[j - 1] + 1)
+            {
+                j++;
+            }
+            fit_free_n(q->pages[i], j - i);
+        }
+        else
+        {
+            policy->free(q->pages[i]);
+        }
+        i = j;
+    }
+    q->count = 0;
+    policy_nfreed += n;
+    return n;
+}
+
+/**
+ * Free a physical page later, in a batch with the other pages freed this way
+ * on the current CPU, for paths that free many pages at once.
+ * The page must have been allocated by palloc, and not be shared.
+ */
+void pfree_deferred(unsigned int pfree_index)
+{
+    struct defer_queue *q = &deferred[get_pcpu_idx()];
+
+    if (q->count == DEFER_SIZE)
     {
-        last_free = pfree_index;
+        pfree_deferred_drain();
     }
+    q->pages[q->count++] = pfree_index;
 }
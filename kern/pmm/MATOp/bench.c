@@ -0,0 +1,218 @@
+#include <lib/debug.h>
+#include <lib/types.h>
+#include <lib/x86.h>
+#include "export.h"
+
+/**
+ * Benchmarks of the page allocator, run at boot when the kernel is built
+ * with BENCH=1.
+ */
+
+#define PAGESIZE 4096
+#define CACHE_LINE 64
+
+// Number of pages of the working set, 128KB.
+#define BENCH_NPAGES 32
+
+// Number of passes over the working set.
+#define BENCH_ROUNDS 64
+
+// Number of short-lived pages in the hot/cold benchmark, 1MB.
+#define BENCH_NREUSE 256
+
+// Number of pages freed at once in the teardown benchmark, 8MB.
+#define BENCH_NTEARDOWN 2048
+
+static unsigned int bench_pages[BENCH_NPAGES];
+static unsigned int bench_other[BENCH_NPAGES];
+static unsigned int bench_reuse[BENCH_NREUSE];
+static unsigned int bench_teardown[BENCH_NTEARDOWN];
+
+/**
+ * Reports the number of colours of the pages in the working set,
+ * and the cycles per cache line of repeated passes over all its lines.
+ */
+static void bench_walk(const char *name, const unsigned int *pages)
+{
+    unsigned int per_colour[NUM_COLOURS];
+    unsigned int ncolours = 0;
+    unsigned int max = 0;
+    unsigned int round;
+    unsigned int i;
+    unsigned int offset;
+    unsigned int sum = 0;
+    uint64_t start;
+
+    for (i = 0; i < NUM_COLOURS; i++)
+    {
+        per_colour[i] = 0;
+    }
+    for (i = 0; i < BENCH_NPAGES; i++)
+    {
+        if (per_colour[pages[i] % NUM_COLOURS]++ == 0)
+        {
+            ncolours++;
+        }
+        if (per_colour[pages[i] % NUM_COLOURS] > max)
+        {
+            max = per_colour[pages[i] % NUM_COLOURS];
+        }
+    }
+
+    start = rdtsc();
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (offset = 0; offset < PAGESIZE; offset += CACHE_LINE)
+        {
+            for (i = 0; i < BENCH_NPAGES; i++)
+            {
+                sum += *(volatile unsigned int *) (pages[i] * PAGESIZE + offset);
+            }
+        }
+    }
+    dprintf("  %s: %u colours, at most %u pages of one colour, %u cycles per line (%u)\n",
+            name, ncolours, max,
+            (unsigned int) (rdtsc() - start) / (BENCH_ROUNDS * BENCH_NPAGES * (PAGESIZE / CACHE_LINE)),
+            sum);
+}
+
+/**
+ * Takes two working sets whose allocations alternate, as two owners
+ * allocating at the same time would, then walks each of them. Under palloc,
+ * consecutive free pages go to the two sets in turn, so each set gets every
+ * other page index and only half of the colours. Under palloc_colour, each
+ * set follows its own colour and gets all of them.
+ */
+static void bench_colour(void)
+{
+    unsigned int colour = 0;
+    unsigned int other_colour = 0;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_NPAGES; i++)
+    {
+        bench_pages[i] = palloc();
+        bench_other[i] = palloc();
+    }
+    bench_walk("palloc, first set", bench_pages);
+    bench_walk("palloc, second set", bench_other);
+    for (i = 0; i < BENCH_NPAGES; i++)
+    {
+        pfree(bench_pages[i]);
+        pfree(bench_other[i]);
+    }
+
+    for (i = 0; i < BENCH_NPAGES; i++)
+    {
+        bench_pages[i] = palloc_colour(&colour);
+        bench_other[i] = palloc_colour(&other_colour);
+    }
+    bench_walk("palloc_colour, first set", bench_pages);
+    bench_walk("palloc_colour, second set", bench_other);
+    for (i = 0; i < BENCH_NPAGES; i++)
+    {
+        pfree(bench_pages[i]);
+        pfree(bench_other[i]);
+    }
+}
+
+/**
+ * Writes all the lines of the page, then reads them back.
+ */
+static unsigned int bench_touch(unsigned int page_index)
+{
+    volatile unsigned int *page = (volatile unsigned int *) (page_index * PAGESIZE);
+    unsigned int sum = 0;
+    unsigned int i;
+
+    for (i = 0; i < PAGESIZE / sizeof(unsigned int); i += CACHE_LINE / sizeof(unsigned int))
+    {
+        page[i] = i;
+    }
+    for (i = 0; i < PAGESIZE / sizeof(unsigned int); i += CACHE_LINE / sizeof(unsigned int))
+    {
+        sum += page[i];
+    }
+    return sum;
+}
+
+/**
+ * Short-lived buffers, each allocated, written, read and freed: palloc reuses
+ * the page just freed, still in the caches, while palloc_cold takes a page
+ * from the AT each time, as a cache-cold allocator would. Both timings include
+ * the frees. The cold pages are only freed after the loop, since once the dirty
+ * list is full, pfree_cold gives them back to the AT, where palloc_cold would
+ * find the page just freed again.
+ */
+static void bench_hot_cold(void)
+{
+    unsigned int i;
+    unsigned int sum = 0;
+    uint64_t start;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_NREUSE; i++)
+    {
+        bench_reuse[i] = palloc();
+        sum += bench_touch(bench_reuse[i]);
+        pfree(bench_reuse[i]);
+    }
+    dprintf("  palloc/pfree: %u cycles per page (%u)\n",
+            (unsigned int) (rdtsc() - start) / BENCH_NREUSE, sum);
+
+    sum = 0;
+    start = rdtsc();
+    for (i = 0; i < BENCH_NREUSE; i++)
+    {
+        bench_reuse[i] = palloc_cold();
+        sum += bench_touch(bench_reuse[i]);
+    }
+    for (i = 0; i < BENCH_NREUSE; i++)
+    {
+        pfree_cold(bench_reuse[i]);
+    }
+    dprintf("  palloc_cold/pfree_cold: %u cycles per page (%u)\n",
+            (unsigned int) (rdtsc() - start) / BENCH_NREUSE, sum);
+}
+
+/**
+ * Frees many pages at once, as the teardown of an address space does:
+ * one pfree per page, then pfree_deferred for each page and one drain.
+ */
+static void bench_deferred(void)
+{
+    unsigned int i;
+    uint64_t start;
+
+    for (i = 0; i < BENCH_NTEARDOWN; i++)
+    {
+        bench_teardown[i] = palloc();
+    }
+    start = rdtsc();
+    for (i = 0; i < BENCH_NTEARDOWN; i++)
+    {
+        pfree(bench_teardown[i]);
+    }
+    dprintf("  pfree: %u cycles per page\n",
+            (unsigned int) (rdtsc() - start) / BENCH_NTEARDOWN);
+
+    for (i = 0; i < BENCH_NTEARDOWN; i++)
+    {
+        bench_teardown[i] = palloc();
+    }
+    start = rdtsc();
+    for (i = 0; i < BENCH_NTEARDOWN; i++)
+    {
+        pfree_deferred(bench_teardown[i]);
+    }
+    pfree_deferred_drain();
+    dprintf("  pfree_deferred: %u cycles per page\n",
+            (unsigned int) (rdtsc() - start) / BENCH_NTEARDOWN);
+}
+
+void bench_MATOp(void)
+{
+    bench_colour();
+    bench_hot_cold();
+    bench_deferred();
+}
@@ -3,9 +3,73 @@
 
 #ifdef _KERN_
 
+#include "policy.h"
+
+// The zones of physical memory, as bits of a zone mask.
+#define ZONE_DMA    0x1
+#define ZONE_NORMAL 0x2
+#define ZONE_HIGH   0x4
+#define ZONE_ALL    (ZONE_DMA | ZONE_NORMAL | ZONE_HIGH)
+
+// The number of cache colours of physical pages.
+#define NUM_COLOURS 16
+
+// The policy selected at boot, unless the kernel command line has pmm_policy=<name>.
+#ifndef PMM_POLICY
+#define PMM_POLICY "lifo"
+#endif
+
+unsigned int palloc_policy_register(const struct palloc_ops *ops);
+unsigned int palloc_policy_select(const char *name);
+const char *palloc_policy_name(void);
+void palloc_stats(struct palloc_stats *stats);
+
 unsigned int palloc(void);
 void pfree(unsigned int pfree_index);
 
+unsigned int palloc_colour(unsigned int *colour);
+
+// Owner tags of allocated pages, up to 255; the others are for callers to pick.
+#define OWNER_NONE 0
+#define OWNER_SLAB 1
+#define OWNER_HEAP 2
+
+unsigned int palloc_owner(unsigned int owner);
+unsigned int palloc_n_owner(unsigned int n, unsigned int owner);
+void palloc_set_owner(unsigned int page_index, unsigned int n, unsigned int owner);
+unsigned int palloc_owner_pages(unsigned int owner, unsigned int *peak);
+
+unsigned int palloc_cold(void);
+void pfree_cold(unsigned int pfree_index);
+
+unsigned int palloc_zone(unsigned int zone_mask);
+unsigned int zone_free_pages(unsigned int zone_mask);
+
+unsigned int palloc_n(unsigned int n);
+void pfree_n(unsigned int pfree_index, unsigned int n);
+
+unsigned int palloc_range(unsigned int lo, unsigned int hi, unsigned int n, unsigned int align);
+void pfree_range(unsigned int pfree_index, unsigned int n);
+
+unsigned int palloc_batch(unsigned int *out, unsigned int n);
+void pfree_batch(unsigned int *pages, unsigned int n);
+
+void pfree_deferred(unsigned int pfree_index);
+unsigned int pfree_deferred_drain(void);
+
+void page_get(unsigned int page_index);
+void page_put(unsigned int page_index);
+
+unsigned int palloc_large(void);
+void pfree_large(unsigned int block);
+unsigned int palloc_large_reserve(unsigned int nblocks);
+
+void palloc_set_watermarks(unsigned int min, unsigned int low, unsigned int high);
+unsigned int palloc_shrinker_register(unsigned int (*shrink)(unsigned int npages));
+
+unsigned int palloc_zeroed(void);
+void palloc_idle(void);
+
 #endif  /* _KERN_ */
 
 #endif  /* !_KERN_PMM_MATOP_H_ */
@@ -19,6 +19,68 @@ unsigned int at_is_allocated(unsigned int page_index);
 // Mark the allocation flag of the page with the given index using the given value.
 void at_set_allocated(unsigned int page_index, unsigned int allocated);
 
+// Mark the allocation flags of the pages [lo, hi) using the given value.
+void at_set_allocated_range(unsigned int lo, unsigned int hi, unsigned int allocated);
+
+// Sets the owner tag of the allocated pages in [lo, hi), moving them
+// to the page count of the new owner.
+void at_set_owner_range(unsigned int lo, unsigned int hi, unsigned int owner);
+
+// The number of allocated pages of the owner, and its highest value in peak.
+unsigned int at_owner_pages(unsigned int owner, unsigned int *peak);
+
+// The reference count of the page with the given index, 0 iff it is not allocated.
+unsigned int at_get_ref(unsigned int page_index);
+
+// Set the reference count of the page with the given index.
+void at_set_ref(unsigned int page_index, unsigned int ref);
+
+// Whether the page with the given index is held in a page cache.
+unsigned int at_is_cached(unsigned int page_index);
+
+// Mark the page with the given index as held in the page cache of a CPU.
+void at_set_cached(unsigned int page_index, unsigned int cached);
+
+// Mark the pages [lo, hi) as held in a page cache, or not.
+void at_set_cached_range(unsigned int lo, unsigned int hi, unsigned int cached);
+
+// The number of pages that are normal, unallocated and not cached.
+unsigned int at_nfree_pages(void);
+
+// The number of pages held in the page caches.
+unsigned int at_ncached_pages(void);
+
+// One word of the free bitmap: bit i is set iff the page with index
+// (word_index * 32 + i) is normal, unallocated and not cached.
+unsigned int at_free_word(unsigned int word_index);
+
+// The index of the first normal and unallocated page not below the given index,
+// or 2^20 if there is none.
+unsigned int at_next_free(unsigned int page_index);
+
+#ifdef ENABLE_PMM_FREELIST
+// The index of the page at the head of the free list, or 2^20 if it is empty.
+unsigned int at_free_head(void);
+#endif
+
+/**
+ * The free-space manager implemented in the MATExtent layer.
+ */
+
+// Adds the pages [start, start + len) to the free extents.
+unsigned int extent_free(unsigned int start, unsigned int len);
+
+// Takes len pages from the shortest long enough extent, or returns 0.
+unsigned int extent_alloc_best(unsigned int len);
+
+// Takes the lowest len free pages in [lo, hi) whose first index is a multiple
+// of align, or returns 0.
+unsigned int extent_alloc_range(unsigned int lo, unsigned int hi,
+                                unsigned int len, unsigned int align);
+
+// Drops all the free extents.
+void extent_clear(void);
+
 #endif  /* _KERN_ */
 
 #endif  /* !_KERN_PMM_MATOP_H_ */
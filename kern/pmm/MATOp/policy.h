@@ -0,0 +1,33 @@
+#ifndef _KERN_PMM_MATOP_POLICY_H_
+#define _KERN_PMM_MATOP_POLICY_H_
+
+#ifdef _KERN_
+
+/**
+ * An allocation policy behind palloc, pfree, palloc_n and pfree_n.
+ * stats only fills in cached, the free pages the policy holds out of the AT.
+ * It has its own header, since MATOp.c and the layers that implement a policy
+ * cannot include export.h next to their import.h.
+ */
+struct palloc_stats
+{
+    unsigned int nalloc;   // pages allocated through the policy
+    unsigned int nfreed;   // pages freed through the policy
+    unsigned int nfailed;  // allocations that failed
+    unsigned int at_free;  // free pages in the AT
+    unsigned int cached;   // free pages held by the policy
+};
+
+struct palloc_ops
+{
+    const char *name;
+    unsigned int (*alloc)(void);
+    void (*free)(unsigned int page_index);
+    unsigned int (*alloc_n)(unsigned int n);
+    void (*free_n)(unsigned int page_index, unsigned int n);
+    void (*stats)(struct palloc_stats *stats);
+};
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATOP_POLICY_H_ */
@@ -1,4 +1,5 @@
 #include <lib/debug.h>
+#include <lib/string.h>
 #include <pmm/MATIntro/export.h>
 #include "export.h"
 
@@ -39,6 +40,512 @@ int MATOp_test1()
     return 0;
 }
 
+int MATOp_test2()
+{
+    unsigned int i;
+    unsigned int page_index = palloc_n(40);
+    if (page_index < VM_USERLO_PI || VM_USERHI_PI <= page_index + 40)
+    {
+        dprintf("test 2.1 failed: (%d < VM_USERLO_PI || VM_USERHI_PI <= %d + 40)\n", page_index, page_index);
+        pfree_n(page_index, 40);
+        return 1;
+    }
+    for (i = page_index; i < page_index + 40; i++)
+    {
+        if (at_is_norm(i) != 1 || at_is_allocated(i) != 1)
+        {
+            dprintf("test 2.2 failed (i = %d): (%d != 1 || %d != 1)\n", i, at_is_norm(i), at_is_allocated(i));
+            pfree_n(page_index, 40);
+            return 1;
+        }
+    }
+    pfree_n(page_index, 40);
+    for (i = page_index; i < page_index + 40; i++)
+    {
+        if (at_is_allocated(i) != 0)
+        {
+            dprintf("test 2.3 failed (i = %d): (%d != 0)\n", i, at_is_allocated(i));
+            return 1;
+        }
+    }
+    if (palloc_n(0) != 0)
+    {
+        dprintf("test 2.4 failed: (%d != 0)\n", palloc_n(0));
+        return 1;
+    }
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+int MATOp_test3()
+{
+    unsigned int page_index = palloc();
+    pfree(page_index);
+    if (at_is_allocated(page_index) != 0)
+    {
+        dprintf("test 3.1 failed: (%d != 0)\n", at_is_allocated(page_index));
+        return 1;
+    }
+    // only the lifo policy keeps the freed page out of the AT, to hand it out first
+    if (strcmp(palloc_policy_name(), "lifo") == 0)
+    {
+        if (at_next_free(page_index) == page_index)
+        {
+            dprintf("test 3.2 failed: (%d == %d)\n", at_next_free(page_index), page_index);
+            return 1;
+        }
+        if (palloc() != page_index)
+        {
+            dprintf("test 3.3 failed: the page freed last is not allocated first\n");
+            return 1;
+        }
+        pfree(page_index);
+    }
+    dprintf("test 3 passed.\n");
+    return 0;
+}
+
+int MATOp_test4()
+{
+    struct palloc_stats before, after;
+    unsigned int pages[100];
+    unsigned int i, j;
+    if (palloc_batch(pages, 100) != 100)
+    {
+        dprintf("test 4.1 failed: fewer than 100 pages allocated\n");
+        return 1;
+    }
+    for (i = 0; i < 100; i++)
+    {
+        if (pages[i] < VM_USERLO_PI || VM_USERHI_PI <= pages[i]
+            || at_is_norm(pages[i]) != 1 || at_is_allocated(pages[i]) != 1)
+        {
+            dprintf("test 4.2 failed (i = %d): page %d\n", i, pages[i]);
+            pfree_batch(pages, 100);
+            return 1;
+        }
+        for (j = 0; j < i; j++)
+        {
+            if (pages[j] == pages[i])
+            {
+                dprintf("test 4.3 failed: page %d allocated twice\n", pages[i]);
+                pfree_batch(pages, 100);
+                return 1;
+            }
+        }
+    }
+    // free in reverse order, so the batch has to sort them
+    for (i = 0; i < 50; i++)
+    {
+        j = pages[i];
+        pages[i] = pages[99 - i];
+        pages[99 - i] = j;
+    }
+    pfree_batch(pages, 100);
+    for (i = 0; i < 100; i++)
+    {
+        if (at_is_allocated(pages[i]) != 0 || (i > 0 && pages[i] <= pages[i - 1]))
+        {
+            dprintf("test 4.4 failed (i = %d): page %d\n", i, pages[i]);
+            return 1;
+        }
+    }
+    // freeing the pages again gives nothing back
+    palloc_stats(&before);
+    pfree_batch(pages, 100);
+    palloc_stats(&after);
+    if (after.at_free != before.at_free || after.cached != before.cached || after.nfreed != before.nfreed)
+    {
+        dprintf("test 4.5 failed: the pages were freed twice\n");
+        return 1;
+    }
+    dprintf("test 4 passed.\n");
+    return 0;
+}
+
+int MATOp_test5()
+{
+    unsigned int page_index;
+    unsigned int *page;
+    unsigned int i;
+    for (i = 0; i < 4; i++)
+    {
+        palloc_idle();
+    }
+    page_index = palloc_zeroed();
+    if (page_index < VM_USERLO_PI || VM_USERHI_PI <= page_index || at_is_allocated(page_index) != 1)
+    {
+        dprintf("test 5.1 failed: page %d\n", page_index);
+        return 1;
+    }
+    page = (unsigned int *) (page_index * PAGESIZE);
+    for (i = 0; i < PAGESIZE / sizeof(unsigned int); i++)
+    {
+        if (page[i] != 0)
+        {
+            dprintf("test 5.2 failed (i = %d): (%d != 0)\n", i, page[i]);
+            pfree(page_index);
+            return 1;
+        }
+    }
+    page[0] = 0xdeadbeef;
+    pfree(page_index);
+    dprintf("test 5 passed.\n");
+    return 0;
+}
+
+int MATOp_test6()
+{
+    unsigned int page_index = palloc();
+    page_get(page_index);
+    page_get(page_index);
+    page_put(page_index);
+    if (at_get_ref(page_index) != 2 || at_is_allocated(page_index) != 1)
+    {
+        dprintf("test 6.1 failed: (%d != 2 || %d != 1)\n", at_get_ref(page_index), at_is_allocated(page_index));
+        pfree(page_index);
+        return 1;
+    }
+    page_put(page_index);
+    page_put(page_index);
+    if (at_get_ref(page_index) != 0 || at_is_allocated(page_index) != 0)
+    {
+        dprintf("test 6.2 failed: (%d != 0 || %d != 0)\n", at_get_ref(page_index), at_is_allocated(page_index));
+        return 1;
+    }
+    page_get(page_index);
+    if (at_get_ref(page_index) != 0)
+    {
+        dprintf("test 6.3 failed: (%d != 0)\n", at_get_ref(page_index));
+        return 1;
+    }
+    // a saturated count sticks, so the page is not freed under its other users
+    page_index = palloc();
+    at_set_ref(page_index, 0xffff);
+    page_get(page_index);
+    page_put(page_index);
+    if (at_get_ref(page_index) != 0xffff || at_is_allocated(page_index) != 1)
+    {
+        dprintf("test 6.4 failed: (%d != 0xffff || %d != 1)\n", at_get_ref(page_index), at_is_allocated(page_index));
+        return 1;
+    }
+    at_set_ref(page_index, 1);
+    page_put(page_index);
+    dprintf("test 6 passed.\n");
+    return 0;
+}
+
+int MATOp_test7()
+{
+    unsigned int block = palloc_large();
+    if (block < VM_USERLO_PI || VM_USERHI_PI < block + 1024 || block % 1024 != 0)
+    {
+        dprintf("test 7.1 failed: (%d is not an aligned 4MB block)\n", block);
+        if (block != 0)
+        {
+            pfree_large(block);
+        }
+        return 1;
+    }
+    if (at_is_allocated(block) != 1 || at_is_allocated(block + 1023) != 1)
+    {
+        dprintf("test 7.2 failed: (%d != 1 || %d != 1)\n", at_is_allocated(block), at_is_allocated(block + 1023));
+        pfree_large(block);
+        return 1;
+    }
+    pfree_large(block);
+    if (at_is_allocated(block) != 0 || at_is_allocated(block + 1023) != 0)
+    {
+        dprintf("test 7.3 failed: (%d != 0 || %d != 0)\n", at_is_allocated(block), at_is_allocated(block + 1023));
+        return 1;
+    }
+    dprintf("test 7 passed.\n");
+    return 0;
+}
+
+int MATOp_test8()
+{
+    unsigned int page_index;
+    if (zone_free_pages(ZONE_ALL)
+        != zone_free_pages(ZONE_DMA) + zone_free_pages(ZONE_NORMAL) + zone_free_pages(ZONE_HIGH))
+    {
+        dprintf("test 8.1 failed: the zones do not add up\n");
+        return 1;
+    }
+    // memory below VM_USERLO is reserved by the kernel, so the DMA zone is empty
+    if (palloc_zone(ZONE_DMA) != 0)
+    {
+        dprintf("test 8.2 failed: (palloc_zone(ZONE_DMA) != 0)\n");
+        return 1;
+    }
+    if (zone_free_pages(ZONE_NORMAL) > 0)
+    {
+        page_index = palloc_zone(ZONE_NORMAL);
+        if (page_index < VM_USERLO_PI || 0x80000 <= page_index || at_is_allocated(page_index) != 1)
+        {
+            dprintf("test 8.3 failed: page %d is not in the normal zone\n", page_index);
+            if (page_index != 0)
+            {
+                pfree(page_index);
+            }
+            return 1;
+        }
+        pfree(page_index);
+    }
+    dprintf("test 8 passed.\n");
+    return 0;
+}
+
+int MATOp_test9()
+{
+    unsigned int pages[2 * NUM_COLOURS];
+    unsigned int colour = 3;
+    unsigned int i;
+    for (i = 0; i < 2 * NUM_COLOURS; i++)
+    {
+        pages[i] = palloc_colour(&colour);
+        if (pages[i] == 0 || at_is_allocated(pages[i]) != 1)
+        {
+            dprintf("test 9.1 failed: page %d of colour %d not allocated\n", pages[i], (3 + i) % NUM_COLOURS);
+            return 1;
+        }
+        // there is plenty of free memory, so every colour is available
+        if (pages[i] % NUM_COLOURS != (3 + i) % NUM_COLOURS)
+        {
+            dprintf("test 9.2 failed: (%d %% %d != %d)\n", pages[i], NUM_COLOURS, (3 + i) % NUM_COLOURS);
+            return 1;
+        }
+    }
+    if (colour != 3)
+    {
+        dprintf("test 9.3 failed: (colour != 3)\n");
+        return 1;
+    }
+    for (i = 0; i < 2 * NUM_COLOURS; i++)
+    {
+        pfree(pages[i]);
+    }
+    dprintf("test 9 passed.\n");
+    return 0;
+}
+
+int MATOp_test10()
+{
+    struct palloc_stats before, after;
+    const char *policy = palloc_policy_name();
+    unsigned int page_index;
+    palloc_stats(&before);
+    page_index = palloc();
+    palloc_stats(&after);
+    if (page_index == 0 || after.nalloc != before.nalloc + 1)
+    {
+        dprintf("test 10.1 failed: (nalloc %d != %d)\n", after.nalloc, before.nalloc + 1);
+        return 1;
+    }
+    pfree(page_index);
+    palloc_stats(&after);
+    if (after.nfreed != before.nfreed + 1)
+    {
+        dprintf("test 10.2 failed: (nfreed %d != %d)\n", after.nfreed, before.nfreed + 1);
+        return 1;
+    }
+    // pages have been allocated through the current policy, so it cannot change
+    if (palloc_policy_select("nextfit") != 0 || palloc_policy_select("no such policy") != 0)
+    {
+        dprintf("test 10.3 failed: the policy changed after allocations\n");
+        return 1;
+    }
+    if (strcmp(palloc_policy_name(), policy) != 0)
+    {
+        dprintf("test 10.4 failed: policy %s instead of %s\n", palloc_policy_name(), policy);
+        return 1;
+    }
+    dprintf("test 10 passed.\n");
+    return 0;
+}
+
+int MATOp_test11()
+{
+    struct palloc_stats before, after;
+    unsigned int page_index;
+    page_index = palloc_range(0x50000, 0x60000, 4, 16);
+    if (page_index < 0x50000 || page_index + 4 > 0x60000 || page_index % 16 != 0)
+    {
+        dprintf("test 11.1 failed: run at %d not in the window or not aligned\n", page_index);
+        return 1;
+    }
+    if (at_is_allocated(page_index) != 1 || at_is_allocated(page_index + 3) != 1)
+    {
+        dprintf("test 11.2 failed: run at %d not allocated\n", page_index);
+        return 1;
+    }
+    pfree_range(page_index, 4);
+    if (at_is_allocated(page_index) != 0)
+    {
+        dprintf("test 11.3 failed: run at %d not freed\n", page_index);
+        return 1;
+    }
+    // the window below VM_USERLO is reserved by the kernel
+    palloc_stats(&before);
+    if (palloc_range(0, VM_USERLO_PI, 1, 1) != 0)
+    {
+        dprintf("test 11.4 failed: (palloc_range(0, VM_USERLO_PI, 1, 1) != 0)\n");
+        return 1;
+    }
+    // and is given up at once, without draining the caches and the reserve
+    palloc_stats(&after);
+    if (after.at_free != before.at_free)
+    {
+        dprintf("test 11.5 failed: (at_free %d != %d)\n", after.at_free, before.at_free);
+        return 1;
+    }
+    dprintf("test 11 passed.\n");
+    return 0;
+}
+
+int MATOp_test12()
+{
+    struct palloc_stats before, after;
+    unsigned int hot, cold;
+    unsigned int pages[4];
+    unsigned int lifo = strcmp(palloc_policy_name(), "lifo") == 0;
+    hot = palloc();
+    pfree(hot);
+    cold = palloc_cold();
+    // only the lifo policy keeps the hot page away from palloc_cold
+    if (cold == 0 || (lifo && cold == hot) || at_is_allocated(cold) != 1)
+    {
+        dprintf("test 12.1 failed: palloc_cold returned page %d, the hot page is %d\n", cold, hot);
+        return 1;
+    }
+    pfree_cold(cold);
+    if (at_is_allocated(cold) != 0)
+    {
+        dprintf("test 12.2 failed: page %d not freed\n", cold);
+        return 1;
+    }
+    // the cold page does not go on the magazine, so the hot page is still on top
+    if (lifo)
+    {
+        if (palloc() != hot)
+        {
+            dprintf("test 12.3 failed: the hot page %d was not reused\n", hot);
+            return 1;
+        }
+        pfree(hot);
+    }
+    // a page freed twice is only handed out once
+    hot = palloc();
+    palloc_stats(&before);
+    pfree(hot);
+    pfree(hot);
+    palloc_stats(&after);
+    if (after.nfreed != before.nfreed + 1)
+    {
+        dprintf("test 12.4 failed: page %d freed %d times\n", hot, after.nfreed - before.nfreed);
+        return 1;
+    }
+    pages[0] = palloc();
+    pages[1] = palloc();
+    pfree_cold(pages[1]);
+    pfree_cold(pages[1]);
+    pages[2] = palloc_cold();
+    pages[3] = palloc_cold();
+    if (pages[0] == pages[1] || pages[2] == pages[3])
+    {
+        dprintf("test 12.5 failed: pages %d, %d, %d and %d\n", pages[0], pages[1], pages[2], pages[3]);
+        return 1;
+    }
+    pfree(pages[0]);
+    pfree(pages[2]);
+    pfree(pages[3]);
+    dprintf("test 12 passed.\n");
+    return 0;
+}
+
+int MATOp_test13()
+{
+    unsigned int live, peak, page_index;
+    live = palloc_owner_pages(100, &peak);
+    page_index = palloc_owner(100);
+    if (page_index == 0 || palloc_owner_pages(100, &peak) != live + 1 || peak < live + 1)
+    {
+        dprintf("test 13.1 failed: (%d != %d || peak %d)\n", palloc_owner_pages(100, &peak), live + 1, peak);
+        return 1;
+    }
+    pfree(page_index);
+    if (palloc_owner_pages(100, &peak) != live)
+    {
+        dprintf("test 13.2 failed: (%d != %d)\n", palloc_owner_pages(100, &peak), live);
+        return 1;
+    }
+    page_index = palloc_n_owner(3, 100);
+    if (page_index == 0 || palloc_owner_pages(100, &peak) != live + 3)
+    {
+        dprintf("test 13.3 failed: (%d != %d)\n", palloc_owner_pages(100, &peak), live + 3);
+        return 1;
+    }
+    pfree_n(page_index, 3);
+    if (palloc_owner_pages(100, &peak) != live || peak < live + 3)
+    {
+        dprintf("test 13.4 failed: (%d != %d || peak %d)\n", palloc_owner_pages(100, &peak), live, peak);
+        return 1;
+    }
+    dprintf("test 13 passed.\n");
+    return 0;
+}
+
+int MATOp_test14()
+{
+    unsigned int pages[3];
+    unsigned int i;
+    for (i = 0; i < 3; i++)
+    {
+        pages[i] = palloc();
+    }
+    for (i = 0; i < 3; i++)
+    {
+        pfree_deferred(pages[i]);
+    }
+    if (at_is_allocated(pages[0]) != 1)
+    {
+        dprintf("test 14.1 failed: page %d freed before the drain\n", pages[0]);
+        return 1;
+    }
+    if (pfree_deferred_drain() != 3)
+    {
+        dprintf("test 14.2 failed: the drain did not free 3 pages\n");
+        return 1;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        if (at_is_allocated(pages[i]) != 0)
+        {
+            dprintf("test 14.3 failed: page %d not freed\n", pages[i]);
+            return 1;
+        }
+    }
+    if (pfree_deferred_drain() != 0)
+    {
+        dprintf("test 14.4 failed: the queue was not emptied\n");
+        return 1;
+    }
+    // a page queued twice, or already freed, is only given back once
+    pages[0] = palloc();
+    pages[1] = palloc();
+    pfree(pages[1]);
+    pfree_deferred(pages[0]);
+    pfree_deferred(pages[0]);
+    pfree_deferred(pages[1]);
+    if (pfree_deferred_drain() != 1 || at_is_allocated(pages[0]) != 0)
+    {
+        dprintf("test 14.5 failed: pages %d and %d not given back once\n", pages[0], pages[1]);
+        return 1;
+    }
+    dprintf("test 14 passed.\n");
+    return 0;
+}
+
 /**
  * Write Your Own Test Script (optional)
  *
@@ -57,20 +564,52 @@ int MATOp_test_own()
     // TODO (optional)
     // dprintf("own test passed.\n");
     unsigned int num_palloc = 0;
-    while (palloc() != 0)
+    unsigned int nfree;
+    unsigned int i;
+    unsigned int first = VM_USERHI_PI;
+    unsigned int last = 0;
+    unsigned int page_index;
+    while ((page_index = palloc()) != 0)
     {
+        if (page_index < first)
+        {
+            first = page_index;
+        }
+        if (page_index > last)
+        {
+            last = page_index;
+        }
         num_palloc++;
     }
+    // give the pages back, so that the tests of the upper layers have memory to use
+    for (page_index = first; page_index <= last; page_index++)
+    {
+        if (at_is_norm(page_index) && at_is_allocated(page_index))
+        {
+            pfree(page_index);
+        }
+    }
     if (num_palloc != 262112)
     {
         dprintf("own test 1 failed: (%d != 262112)\n", num_palloc);
         return 1;
     }
+    // the reserved 4MB blocks broken up on the way are replaced at idle time
+    nfree = zone_free_pages(ZONE_ALL);
+    for (i = 0; i < 8; i++)
+    {
+        palloc_idle();
+    }
+    if (nfree < zone_free_pages(ZONE_ALL) + 1024)
+    {
+        dprintf("own test 2 failed: (%d < %d + 1024)\n", nfree, zone_free_pages(ZONE_ALL));
+        return 1;
+    }
     dprintf("own test passed.\n");
     return 0;
 }
 
 int test_MATOp()
 {
-    return MATOp_test1() + MATOp_test_own();
+    return MATOp_test1() + MATOp_test2() + MATOp_test3() + MATOp_test4() + MATOp_test5() + MATOp_test6() + MATOp_test7() + MATOp_test8() + MATOp_test9() + MATOp_test10() + MATOp_test11() + MATOp_test12() + MATOp_test13() + MATOp_test14() + MATOp_test_own();
 }
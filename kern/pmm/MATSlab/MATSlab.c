@@ -0,0 +1,372 @@
+#include <lib/debug.h>
+#include <lib/types.h>
+#include "import.h"
+
+#define PAGESIZE 4096
+#define VM_USERLO 0x40000000
+#define VM_USERHI 0xF0000000
+#define VM_USERLO_PI (VM_USERLO / PAGESIZE)
+#define VM_USERHI_PI (VM_USERHI / PAGESIZE)
+
+/**
+ * The slab allocator hands out objects of a fixed size from caches.
+ * Each cache takes whole pages from palloc, the slabs, and cuts them into
+ * objects of its size. A slab keeps its header at the beginning of its first page,
+ * followed by the objects, and the free objects of a slab are linked through
+ * their first word. So the slab of an object is found by rounding its address
+ * down to the page (or to the slab, see below), and allocating or freeing
+ * an object takes constant time.
+ *
+ * The slabs of a cache are kept in three lists:
+ *   partial: some objects are free, the objects are taken from here first.
+ *   full: no object is free.
+ *   empty: all objects are free. At most KMEM_MAX_EMPTY slabs are kept here,
+ *     the others are given back to palloc. kmem_reap gives them all back
+ *     when the page allocator runs low.
+ */
+#define KMEM_MAX_EMPTY 1
+
+/**
+ * A page holds fewer than KMEM_MIN_OBJS objects larger than a third of it,
+ * and up to half of it is lost past the last one. The caches of such objects
+ * take slabs of KMEM_BIG_PAGES contiguous pages instead, aligned to their size,
+ * so the loss is spread over more objects. Their objects may lie past the
+ * first page of the slab, where the slab is then found by rounding the address
+ * down to the slab size: kmem_big has a bit for each aligned run of
+ * KMEM_BIG_PAGES user pages, set while the run is such a slab.
+ */
+#define KMEM_MIN_OBJS  3
+#define KMEM_BIG_PAGES 4
+
+struct slab
+{
+    struct kmem_cache *cache;
+    struct slab *prev;
+    struct slab *next;
+    void *free;
+    unsigned int inuse;
+};
+
+struct slab_list
+{
+    struct slab *head;
+    unsigned int count;
+};
+
+struct kmem_cache
+{
+    unsigned int size;
+    unsigned int offset;
+    unsigned int nobjs;
+    unsigned int npages;
+    struct slab_list partial;
+    struct slab_list full;
+    struct slab_list empty;
+};
+
+/**
+ * The caches themselves are taken from a static pool, since there is no
+ * allocator below this layer for objects smaller than a page.
+ */
+#define KMEM_NCACHES 64
+
+static struct kmem_cache kmem_caches[KMEM_NCACHES];
+static unsigned int kmem_ncaches = 0;
+
+#define KMEM_NRUNS ((VM_USERHI_PI - VM_USERLO_PI) / KMEM_BIG_PAGES)
+
+static unsigned int kmem_big[KMEM_NRUNS / 32 + 1];
+
+#define KMEM_BIG_BIT(page_index) (((page_index) - VM_USERLO_PI) / KMEM_BIG_PAGES)
+
+static unsigned int kmem_is_big(unsigned int page_index)
+{
+    unsigned int bit;
+
+    if (page_index < VM_USERLO_PI || page_index >= VM_USERHI_PI)
+    {
+        return 0;
+    }
+    bit = KMEM_BIG_BIT(page_index);
+    return (kmem_big[bit / 32] >> (bit % 32)) & 0x1;
+}
+
+static void kmem_set_big(unsigned int page_index, unsigned int big)
+{
+    unsigned int bit = KMEM_BIG_BIT(page_index);
+
+    if (big)
+    {
+        kmem_big[bit / 32] |= 1u << (bit % 32);
+    }
+    else
+    {
+        kmem_big[bit / 32] &= ~(1u << (bit % 32));
+    }
+}
+
+/**
+ * Returns the slab an object is in: the page of the object,
+ * or the beginning of its run if the run is a multi-page slab.
+ */
+static struct slab *slab_of(void *obj)
+{
+    unsigned int page_index = (uintptr_t) obj / PAGESIZE;
+
+    if (kmem_is_big(page_index))
+    {
+        page_index = ROUNDDOWN(page_index, KMEM_BIG_PAGES);
+    }
+    return (struct slab *) (page_index * PAGESIZE);
+}
+
+static void slab_push(struct slab_list *list, struct slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = list->head;
+    if (list->head != NULL)
+    {
+        list->head->prev = slab;
+    }
+    list->head = slab;
+    list->count++;
+}
+
+static void slab_remove(struct slab_list *list, struct slab *slab)
+{
+    if (slab->prev != NULL)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        list->head = slab->next;
+    }
+    if (slab->next != NULL)
+    {
+        slab->next->prev = slab->prev;
+    }
+    list->count--;
+}
+
+/**
+ * Takes the pages of a slab from the page allocator and lays out a slab
+ * of the cache in them, with all of its objects free.
+ * Returns NULL if there are no free pages.
+ */
+static struct slab *slab_create(struct kmem_cache *cache)
+{
+    unsigned int page_index;
+    struct slab *slab;
+    char *obj;
+    unsigned int i;
+
+    if (cache->npages == 1)
+    {
+        page_index = palloc_owner(OWNER_SLAB);
+    }
+    else
+    {
+        page_index = palloc_range(VM_USERLO_PI, VM_USERHI_PI, cache->npages, cache->npages);
+        if (page_index != 0)
+        {
+            palloc_set_owner(page_index, cache->npages, OWNER_SLAB);
+            kmem_set_big(page_index, 1);
+        }
+    }
+    if (page_index == 0)
+    {
+        return NULL;
+    }
+
+    slab = (struct slab *) (page_index * PAGESIZE);
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = NULL;
+    obj = (char *) slab + cache->offset + (cache->nobjs - 1) * cache->size;
+    for (i = 0; i < cache->nobjs; i++)
+    {
+        *(void **) obj = slab->free;
+        slab->free = obj;
+        obj -= cache->size;
+    }
+    return slab;
+}
+
+/**
+ * Gives the pages of an empty slab back to the page allocator.
+ */
+static void slab_destroy(struct slab *slab)
+{
+    unsigned int page_index = (uintptr_t) slab / PAGESIZE;
+
+    if (slab->cache->npages == 1)
+    {
+        pfree(page_index);
+    }
+    else
+    {
+        kmem_set_big(page_index, 0);
+        pfree_range(page_index, slab->cache->npages);
+    }
+}
+
+/**
+ * Creates a cache of objects of the given size, aligned to the given
+ * power of two (0 means the alignment of a pointer).
+ * Returns NULL if an object would not fit in a page after the slab header,
+ * or if there is no cache left in the pool.
+ */
+struct kmem_cache *kmem_cache_create(unsigned int size, unsigned int align)
+{
+    struct kmem_cache *cache;
+
+    if ((align & (align - 1)) != 0 || size == 0 || size > PAGESIZE)
+    {
+        return NULL;
+    }
+    if (align < sizeof(void *))
+    {
+        align = sizeof(void *);
+    }
+    if (kmem_ncaches == KMEM_NCACHES)
+    {
+        return NULL;
+    }
+
+    size = ROUNDUP(size, align);
+    if (ROUNDUP((unsigned int) sizeof(struct slab), align) + size > PAGESIZE)
+    {
+        return NULL;
+    }
+
+    cache = &kmem_caches[kmem_ncaches++];
+    cache->size = size;
+    cache->offset = ROUNDUP((unsigned int) sizeof(struct slab), align);
+    cache->npages = 1;
+    if ((PAGESIZE - cache->offset) / size < KMEM_MIN_OBJS)
+    {
+        cache->npages = KMEM_BIG_PAGES;
+    }
+    cache->nobjs = (cache->npages * PAGESIZE - cache->offset) / size;
+    cache->partial.head = cache->full.head = cache->empty.head = NULL;
+    cache->partial.count = cache->full.count = cache->empty.count = 0;
+    return cache;
+}
+
+/**
+ * Allocates an object from the cache.
+ * The object is taken from a partial slab, or else from an empty one,
+ * or else from a new slab. Returns NULL if there is no memory left.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cache)
+{
+    struct slab *slab;
+    void *obj;
+
+    slab = cache->partial.head;
+    if (slab == NULL)
+    {
+        slab = cache->empty.head;
+        if (slab != NULL)
+        {
+            slab_remove(&cache->empty, slab);
+        }
+        else
+        {
+            slab = slab_create(cache);
+            if (slab == NULL)
+            {
+                return NULL;
+            }
+        }
+        slab_push(&cache->partial, slab);
+    }
+
+    obj = slab->free;
+    slab->free = *(void **) obj;
+    slab->inuse++;
+    if (slab->inuse == cache->nobjs)
+    {
+        slab_remove(&cache->partial, slab);
+        slab_push(&cache->full, slab);
+    }
+    return obj;
+}
+
+/**
+ * Frees an object allocated from the cache.
+ */
+void kmem_cache_free(struct kmem_cache *cache, void *obj)
+{
+    struct slab *slab = slab_of(obj);
+
+    KERN_ASSERT(slab->cache == cache);
+
+    *(void **) obj = slab->free;
+    slab->free = obj;
+    if (slab->inuse == cache->nobjs)
+    {
+        slab_remove(&cache->full, slab);
+        slab_push(&cache->partial, slab);
+    }
+    slab->inuse--;
+    if (slab->inuse == 0)
+    {
+        slab_remove(&cache->partial, slab);
+        if (cache->empty.count < KMEM_MAX_EMPTY)
+        {
+            slab_push(&cache->empty, slab);
+        }
+        else
+        {
+            slab_destroy(slab);
+        }
+    }
+}
+
+/**
+ * Returns the cache of an object, which is read from the first word of its
+ * slab. For a page that is not in a slab, the first word of the page
+ * has to be 0 for the result to be meaningful (NULL).
+ */
+struct kmem_cache *kmem_cache_of(void *obj)
+{
+    return slab_of(obj)->cache;
+}
+
+/**
+ * Returns the size of the objects of the cache, which may be larger
+ * than the size it was created with.
+ */
+unsigned int kmem_cache_size(struct kmem_cache *cache)
+{
+    return cache->size;
+}
+
+/**
+ * Gives the empty slabs of all the caches back to the page allocator,
+ * stopping once npages pages are freed.
+ * It is registered as a shrinker of the page allocator.
+ * Returns the number of pages freed.
+ */
+unsigned int kmem_reap(unsigned int npages)
+{
+    struct kmem_cache *cache;
+    struct slab *slab;
+    unsigned int freed = 0;
+    unsigned int i;
+
+    for (i = 0; i < kmem_ncaches && freed < npages; i++)
+    {
+        cache = &kmem_caches[i];
+        while (cache->empty.head != NULL && freed < npages)
+        {
+            slab = cache->empty.head;
+            slab_remove(&cache->empty, slab);
+            slab_destroy(slab);
+            freed += cache->npages;
+        }
+    }
+    return freed;
+}
@@ -0,0 +1,19 @@
+#ifndef _KERN_PMM_MATSLAB_H_
+#define _KERN_PMM_MATSLAB_H_
+
+#ifdef _KERN_
+
+struct kmem_cache;
+
+struct kmem_cache *kmem_cache_create(unsigned int size, unsigned int align);
+void *kmem_cache_alloc(struct kmem_cache *cache);
+void kmem_cache_free(struct kmem_cache *cache, void *obj);
+
+struct kmem_cache *kmem_cache_of(void *obj);
+unsigned int kmem_cache_size(struct kmem_cache *cache);
+
+unsigned int kmem_reap(unsigned int npages);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATSLAB_H_ */
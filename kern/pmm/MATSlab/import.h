@@ -0,0 +1,31 @@
+#ifndef _KERN_PMM_MATSLAB_H_
+#define _KERN_PMM_MATSLAB_H_
+
+#ifdef _KERN_
+
+/**
+ * The page allocator implemented in the MATOp layer.
+ */
+
+// The owner tag of the pages of the slabs.
+#define OWNER_SLAB 1
+
+// Allocates a physical page tagged with the owner, or returns 0 if there is none.
+unsigned int palloc_owner(unsigned int owner);
+
+// Frees a physical page.
+void pfree(unsigned int pfree_index);
+
+// Allocates n contiguous pages in [lo, hi) starting at a multiple of align,
+// or returns 0 if there is no such range.
+unsigned int palloc_range(unsigned int lo, unsigned int hi, unsigned int n, unsigned int align);
+
+// Frees n contiguous pages allocated by palloc_range.
+void pfree_range(unsigned int pfree_index, unsigned int n);
+
+// Tags the n allocated pages starting from the given one with the owner.
+void palloc_set_owner(unsigned int page_index, unsigned int n, unsigned int owner);
+
+#endif  /* _KERN_ */
+
+#endif  /* !_KERN_PMM_MATSLAB_H_ */
@@ -0,0 +1,174 @@
+#include <lib/debug.h>
+#include <lib/types.h>
+#include <pmm/MATIntro/export.h>
+#include "export.h"
+
+#define PAGESIZE 4096
+
+int MATSlab_test1()
+{
+    struct kmem_cache *cache = kmem_cache_create(24, 0);
+    unsigned int *obj1;
+    unsigned int *obj2;
+    if (cache == NULL)
+    {
+        dprintf("test 1.1 failed: (cache == NULL)\n");
+        return 1;
+    }
+    obj1 = kmem_cache_alloc(cache);
+    obj2 = kmem_cache_alloc(cache);
+    if (obj1 == NULL || obj2 == NULL || obj1 == obj2)
+    {
+        dprintf("test 1.2 failed: (%p == NULL || %p == NULL || %p == %p)\n", obj1, obj2, obj1, obj2);
+        return 1;
+    }
+    if (at_is_allocated((uintptr_t) obj1 / PAGESIZE) != 1)
+    {
+        dprintf("test 1.3 failed: (%d != 1)\n", at_is_allocated((uintptr_t) obj1 / PAGESIZE));
+        return 1;
+    }
+    kmem_cache_free(cache, obj1);
+    if (kmem_cache_alloc(cache) != obj1)
+    {
+        dprintf("test 1.4 failed: the object freed last is not allocated first\n");
+        return 1;
+    }
+    kmem_cache_free(cache, obj1);
+    kmem_cache_free(cache, obj2);
+    dprintf("test 1 passed.\n");
+    return 0;
+}
+
+int MATSlab_test2()
+{
+    struct kmem_cache *cache = kmem_cache_create(1000, 64);
+    void *objs[10];
+    unsigned int i;
+    if (cache == NULL || kmem_cache_create(PAGESIZE, 0) != NULL || kmem_cache_create(8, 3) != NULL)
+    {
+        dprintf("test 2.1 failed: bad cache arguments\n");
+        return 1;
+    }
+    // 3 objects of 1024 bytes per slab, so 4 slabs
+    for (i = 0; i < 10; i++)
+    {
+        objs[i] = kmem_cache_alloc(cache);
+        if (objs[i] == NULL || (uintptr_t) objs[i] % 64 != 0)
+        {
+            dprintf("test 2.2 failed (i = %d): %p\n", i, objs[i]);
+            return 1;
+        }
+    }
+    if ((uintptr_t) objs[0] / PAGESIZE == (uintptr_t) objs[3] / PAGESIZE)
+    {
+        dprintf("test 2.3 failed: more than 3 objects in a slab\n");
+        return 1;
+    }
+    for (i = 0; i < 10; i++)
+    {
+        kmem_cache_free(cache, objs[i]);
+    }
+    // only one empty slab is kept
+    if (at_is_allocated((uintptr_t) objs[0] / PAGESIZE) + at_is_allocated((uintptr_t) objs[3] / PAGESIZE)
+        + at_is_allocated((uintptr_t) objs[6] / PAGESIZE) + at_is_allocated((uintptr_t) objs[9] / PAGESIZE) != 1)
+    {
+        dprintf("test 2.4 failed: empty slabs not given back\n");
+        return 1;
+    }
+    dprintf("test 2 passed.\n");
+    return 0;
+}
+
+int MATSlab_test3()
+{
+    struct kmem_cache *cache = kmem_cache_create(64, 0);
+    void *obj;
+    unsigned int page_index;
+    if (cache == NULL || (obj = kmem_cache_alloc(cache)) == NULL)
+    {
+        dprintf("test 3.1 failed: (cache == NULL || obj == NULL)\n");
+        return 1;
+    }
+    // the slab of the object is kept as the empty slab of the cache
+    page_index = (uintptr_t) obj / PAGESIZE;
+    kmem_cache_free(cache, obj);
+    if (at_is_allocated(page_index) != 1)
+    {
+        dprintf("test 3.2 failed: the empty slab was not kept\n");
+        return 1;
+    }
+    if (kmem_reap(~0u) == 0 || at_is_allocated(page_index) != 0)
+    {
+        dprintf("test 3.3 failed: the empty slab was not reaped\n");
+        return 1;
+    }
+    if (kmem_reap(~0u) != 0)
+    {
+        dprintf("test 3.4 failed: empty slabs left after reaping\n");
+        return 1;
+    }
+    dprintf("test 3 passed.\n");
+    return 0;
+}
+
+/**
+ * Write Your Own Test Script (optional)
+ *
+ * Come up with your own interesting test cases to challenge your classmates!
+ * In addition to the provided simple tests, selected (correct and interesting) test functions
+ * will be used in the actual grading of the lab!
+ * Your test function itself will not be graded. So don't be afraid of submitting a wrong script.
+ *
+ * The test function should return 0 for passing the test and a non-zero code for failing the test.
+ * Be extra careful to make sure that if you overwrite some of the kernel data, they are set back to
+ * the original value. O.w., it may make the future test scripts to fail even if you implement all
+ * the functions correctly.
+ */
+int MATSlab_test_own()
+{
+    struct kmem_cache *cache = kmem_cache_create(2048, 0);
+    void *objs[7];
+    unsigned int page_index;
+    unsigned int i;
+    if (cache == NULL)
+    {
+        dprintf("own test 1 failed: (cache == NULL)\n");
+        return 1;
+    }
+    // objects larger than a third of a page get a slab of several pages
+    for (i = 0; i < 7; i++)
+    {
+        objs[i] = kmem_cache_alloc(cache);
+        if (objs[i] == NULL || kmem_cache_of(objs[i]) != cache)
+        {
+            dprintf("own test 2 failed (i = %d): %p\n", i, objs[i]);
+            return 1;
+        }
+    }
+    page_index = (uintptr_t) objs[0] / PAGESIZE;
+    if ((uintptr_t) objs[6] / PAGESIZE == page_index || (uintptr_t) objs[6] / PAGESIZE >= page_index + 4)
+    {
+        dprintf("own test 3 failed: not 7 objects of 2048 bytes in a slab of 4 pages\n");
+        return 1;
+    }
+    for (i = 0; i < 7; i++)
+    {
+        kmem_cache_free(cache, objs[i]);
+    }
+    kmem_reap(~0u);
+    for (i = 0; i < 4; i++)
+    {
+        if (at_is_allocated(page_index + i) != 0)
+        {
+            dprintf("own test 4 failed (i = %d): the slab was not reaped\n", i);
+            return 1;
+        }
+    }
+    dprintf("own test passed.\n");
+    return 0;
+}
+
+int test_MATSlab()
+{
+    return MATSlab_test1() + MATSlab_test2() + MATSlab_test3() + MATSlab_test_own();
+}